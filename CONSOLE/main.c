@@ -231,23 +231,17 @@ void o_exec(char *buf)
 
 void cmd_read(int argc, char **argv)
 {
-	off_t offset;
-	char *data;
-	size_t size = 0;
-
 	if(argc < 2 || argc > 2) {
 		fprintf(stdout, "%s [name]\n", argv[0]);
 		return;
 	}
 
-	offset = o_get_offset(of, argv[1]);
-	if(offset == 0) {
+	/* o_send_entry() escribe directo al descriptor, sin pasar por stdio */
+	fflush(stdout);
+	if(o_send_entry(of, argv[1], 1, 0, 0) < 0) {
 		fprintf(stderr, "%s: entry \"%s\" not found\n", argv[0], argv[1]);
 		return;
 	}
-
-	data = o_access_to_mem(of, offset, &size);
-	write(1, data, size);
 	write(1, "\n", 1);
 }
 
@@ -283,14 +277,11 @@ void cmd_delete(int argc, char **argv)
 
 void cmd_list(int argc, char **argv)
 {
-	ocore_hash_node *node;
-	ocore_hash_position pst;
-
-	pst.node = NULL;
-	pst.idx = 0;
+	const char *name;
+	o_cursor c = {0};
 
-	while( (node = ocore_hash_list(&of->hash, &pst)) )
-		printf("%s\n", node->name);
+	while( (name = o_foreach(of, &c)) )
+		printf("%s\n", name);
 
 }
 
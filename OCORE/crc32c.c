@@ -0,0 +1,103 @@
+/* Felipe Astroza 2006
+ * Ocore crc32c.c
+ * Under GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_HW
+#endif
+
+#include <crc32c.h>
+
+/* Polinomio de Castagnoli, reflejado */
+#define CRC32C_POLY	0x82f63b78
+
+static unsigned int crc32c_table[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static int crc32c_hw;
+
+static void _crc32c_init(void)
+{
+	unsigned int c, i, k;
+
+	for(i = 0; i < 256; i++) {
+		c = i;
+		for(k = 0; k < 8; k++)
+			c = c & 1? (c >> 1) ^ CRC32C_POLY : c >> 1;
+		crc32c_table[0][i] = c;
+	}
+
+	for(i = 0; i < 256; i++)
+		for(k = 1; k < 8; k++)
+			crc32c_table[k][i] = (crc32c_table[k - 1][i] >> 8) ^
+				crc32c_table[0][crc32c_table[k - 1][i] & 0xff];
+
+#ifdef CRC32C_HW
+	__builtin_cpu_init();
+	crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/* _crc32c_sw(): De a 8 bytes con 8 tablas (slice-by-8) */
+static unsigned int _crc32c_sw(unsigned int crc, const unsigned char *p, size_t len)
+{
+	unsigned int lo, hi;
+
+	for(; len && ((size_t)p & 7); len--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	for(; len >= 8; len -= 8, p += 8) {
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+		      crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+		      crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+		      crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+	}
+
+	while(len--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2")))
+static unsigned int _crc32c_hw(unsigned int crc, const unsigned char *p, size_t len)
+{
+	unsigned long long c = crc, v;
+
+	for(; len && ((size_t)p & 7); len--)
+		c = _mm_crc32_u8(c, *p++);
+
+	for(; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+
+	while(len--)
+		c = _mm_crc32_u8(c, *p++);
+
+	return c;
+}
+#endif
+
+/* ocore_crc32c(): Continua 'crc' con 'len' bytes de 'buf'
+ */
+unsigned int ocore_crc32c(unsigned int crc, const void *buf, size_t len)
+{
+	pthread_once(&crc32c_once, _crc32c_init);
+
+	crc = ~crc;
+#ifdef CRC32C_HW
+	if(crc32c_hw)
+		return ~_crc32c_hw(crc, buf, len);
+#endif
+	return ~_crc32c_sw(crc, buf, len);
+}
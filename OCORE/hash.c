@@ -21,24 +21,74 @@ static unsigned int hash_func(const char *name)
 	return h;
 }
 
-inline static ocore_hash_node *
-_ocore_hash_get_bucket(ocore_hash *handle, const char *name, int alloc, unsigned int *idx_out)
+static ocore_hash_node **_ocore_hash_alloc_table(unsigned int size)
 {
-	unsigned int idx = hash_func(name) % handle->size;
+	ocore_hash_node **table;
 
-	if(idx_out)
-		*idx_out = idx;
+	table = calloc(size, sizeof(ocore_hash_node *));
+	if(!table) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	return table;
+}
 
-	if(alloc && !handle->table[idx]) {
-		handle->table[idx] = malloc(sizeof(ocore_hash_node));
-		if(!handle->table[idx]) {
-			perror("malloc");
-			exit(EXIT_FAILURE);
+/* _ocore_hash_rehash_step(): Traslada hasta 'n' buckets de tab[0] a tab[1].
+ * Cuando tab[0] queda vacia, tab[1] pasa a ser la tabla activa.
+ */
+static void _ocore_hash_rehash_step(ocore_hash *handle, unsigned int n)
+{
+	ocore_hash_table *old = &handle->tab[0], *new = &handle->tab[1];
+	ocore_hash_node *node, *next, **tail;
+	unsigned int idx;
+
+	while(n-- && handle->rehash_idx < old->size) {
+		for(node = old->table[handle->rehash_idx]; node; node = next) {
+			next = node->next;
+			idx = node->hash % new->size;
+
+			/* Al final de la cadena, para mantener el orden de insercion */
+			for(tail = &new->table[idx]; *tail; tail = &(*tail)->next)
+				;
+			*tail = node;
+			node->next = NULL;
 		}
-		memset(handle->table[idx], 0, sizeof(ocore_hash_node));
+		old->table[handle->rehash_idx++] = NULL;
+	}
+
+	if(handle->rehash_idx >= old->size) {
+		free(old->table);
+		*old = *new;
+		new->table = NULL;
+		new->size = 0;
+		handle->rehash_idx = 0;
+	}
+}
+
+/* _ocore_hash_resize(): Avanza una redimension en curso o, si la carga
+ * lo requiere, comienza una nueva. Nunca traslada toda la tabla de una vez.
+ */
+static void _ocore_hash_resize(ocore_hash *handle)
+{
+	unsigned int size = handle->tab[0].size;
+
+	if(OCORE_HASH_RESIZING(handle)) {
+		_ocore_hash_rehash_step(handle, OCORE_HASH_REHASH_STEP);
+		return;
 	}
 
-        return handle->table[idx];
+	if(handle->count > size * OCORE_HASH_GROW_LOAD)
+		size *= 2;
+	else if(size > handle->min_size && handle->count * OCORE_HASH_SHRINK_LOAD < size)
+		size = size / 2 < handle->min_size? handle->min_size : size / 2;
+	else
+		return;
+
+	handle->tab[1].table = _ocore_hash_alloc_table(size);
+	handle->tab[1].size = size;
+	handle->rehash_idx = 0;
+	_ocore_hash_rehash_step(handle, OCORE_HASH_REHASH_STEP);
 }
 
 /* ocore_hash_init: Permite asignar la memoria requerida por la tabla
@@ -49,16 +99,79 @@ void ocore_hash_init(ocore_hash *handle, unsigned int size, ocore_hash_free_func
 	unsigned int _size = size? size : DEFAULT_HASHSIZE;
 
 	if(handle) {
-		handle->table = calloc(_size, sizeof(ocore_hash_node *));
-		if(!handle->table) {
-			perror("calloc");
-			exit(EXIT_FAILURE);
-		}
-		handle->size = _size;
+		memset(handle, 0, sizeof(ocore_hash));
+		handle->tab[0].table = _ocore_hash_alloc_table(_size);
+		handle->tab[0].size = _size;
+		handle->min_size = _size;
 		handle->free_func = func;
 	}
 }
 
+/* _ocore_hash_find(): Busca en ambas tablas. Retorna la direccion del puntero
+ * que apunta al nodo (para poder extraerlo) o NULL.
+ */
+static ocore_hash_node **
+_ocore_hash_find(ocore_hash *handle, const char *name)
+{
+	ocore_hash_node **link;
+	ocore_hash_table *t;
+	unsigned int h = hash_func(name);
+	int i;
+
+	for(i = 0; i < 2; i++) {
+		t = &handle->tab[i];
+		if(!t->table)
+			break;
+
+		for(link = &t->table[h % t->size]; *link; link = &(*link)->next)
+			if((*link)->hash == h && strcasecmp(name, (*link)->name) == 0)
+				return link;
+	}
+
+	return NULL;
+}
+
+/* _ocore_hash_link(), _ocore_hash_unlink(): Agregan el nodo al final de la
+ * lista en orden de insercion, o lo sacan de ella.
+ */
+static void _ocore_hash_link(ocore_hash *handle, ocore_hash_node *node)
+{
+	node->list_next = NULL;
+	node->list_prev = handle->last;
+	if(handle->last)
+		handle->last->list_next = node;
+	else
+		handle->first = node;
+	handle->last = node;
+}
+
+static void _ocore_hash_unlink(ocore_hash *handle, ocore_hash_node *node)
+{
+	if(node->list_prev)
+		node->list_prev->list_next = node->list_next;
+	else
+		handle->first = node->list_next;
+	if(node->list_next)
+		node->list_next->list_prev = node->list_prev;
+	else
+		handle->last = node->list_prev;
+}
+
+/* _ocore_hash_insert(): Enlaza el nodo al final de su bucket en la tabla
+ * donde van las nuevas entradas (tab[1] durante una redimension).
+ */
+static void _ocore_hash_insert(ocore_hash *handle, ocore_hash_node *node)
+{
+	ocore_hash_table *t = &handle->tab[OCORE_HASH_RESIZING(handle)? 1 : 0];
+	ocore_hash_node **tail;
+
+	for(tail = &t->table[node->hash % t->size]; *tail; tail = &(*tail)->next)
+		;
+
+	*tail = node;
+	node->next = NULL;
+}
+
 /* ocore_hash_add(): Agrega un nuevo nodo a la hash table
  */
 ocore_hash_node *
@@ -66,31 +179,27 @@ ocore_hash_add(ocore_hash *handle, const char *name, void *value, int dup)
 {
 	ocore_hash_node *node;
 
-	if(!handle || !name) 
+	if(!handle || !name)
 		return NULL;
 
-	for(node = _ocore_hash_get_bucket(handle, name, 1, NULL); node; node = node->next) {
-		if(!node->name)
-			break;
-
-		if(strcasecmp(name, node->name) == 0)
-			return NULL;
+	if(_ocore_hash_find(handle, name))
+		return NULL;
 
-		if(!node->next) {
-			node->next = malloc(sizeof(ocore_hash_node));
-			if(!node->next) {
-				perror("malloc");
-				exit(EXIT_FAILURE);
-			}
-			node = node->next;
-			break;
-		}
+	node = malloc(sizeof(ocore_hash_node));
+	if(!node) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
 	}
 
 	node->name = dup? strdup(name) : (char *)name;
 	node->name_dup = dup;
 	node->value = value;
-	node->next = NULL;
+	node->hash = hash_func(name);
+
+	_ocore_hash_insert(handle, node);
+	_ocore_hash_link(handle, node);
+	handle->count++;
+	_ocore_hash_resize(handle);
 
 	return node;
 }
@@ -98,13 +207,9 @@ ocore_hash_add(ocore_hash *handle, const char *name, void *value, int dup)
 static ocore_hash_node *
 _ocore_hash_get_node(ocore_hash *handle, const char *name)
 {
-	ocore_hash_node *node;
-
-	for(node = _ocore_hash_get_bucket(handle, name, 0, NULL); node; node = node->next)
-		if(strcasecmp(name, node->name) == 0)
-			return node;
+	ocore_hash_node **link = _ocore_hash_find(handle, name);
 
-	return NULL;
+	return link? *link : NULL;
 }
 
 /* ocore_hash_get_node(): Retorna nodo buscado.
@@ -131,26 +236,24 @@ void *ocore_hash_get_value(ocore_hash *handle, const char *name)
 	return node? node->value : NULL;
 }
 
+/* ocore_hash_count(): Retorna el numero de nodos
+ */
+unsigned int ocore_hash_count(ocore_hash *handle)
+{
+	return handle? handle->count : 0;
+}
+
 static ocore_hash_node *
 _ocore_hash_extract(ocore_hash *handle, const char *name)
 {
-	ocore_hash_node *node, *prev = NULL;
-	unsigned int idx;
-	/* Rutina de busqueda y extraccion de nodo */
-	for(node = _ocore_hash_get_bucket(handle, name, 0, &idx); node; node = node->next) {
-		if(strcasecmp(name, node->name) == 0)
-			break;
-
-		prev = node;
-	}
+	ocore_hash_node **link, *node;
 
-	if(!node)
+	link = _ocore_hash_find(handle, name);
+	if(!link)
 		return NULL;
-	if(prev)
-		prev->next = node->next;
 
-	if(handle->table[idx] == node)
-		handle->table[idx] = node->next;
+	node = *link;
+	*link = node->next;
 
 	return node;
 }
@@ -174,7 +277,10 @@ int ocore_hash_remove(ocore_hash *handle, const char *name)
 	if(node->name_dup)
 		free(node->name);
 
+	_ocore_hash_unlink(handle, node);
 	free(node);
+	handle->count--;
+	_ocore_hash_resize(handle);
 	return 1;
 }
 
@@ -183,62 +289,47 @@ int ocore_hash_remove(ocore_hash *handle, const char *name)
 ocore_hash_node *
 ocore_hash_change_key(ocore_hash *handle, const char *old_name, const char *new_name)
 {
-	ocore_hash_node *node, *aux;
-	unsigned int idx;
+	ocore_hash_node *aux;
 
 	if(!handle || !old_name || !new_name)
 		return NULL;
 
-	for(node = _ocore_hash_get_bucket(handle, new_name, 0, &idx); node; node = node->next) {
-		if(strcasecmp(new_name, node->name) == 0)
-			return NULL;
-
-		if(!node->next)
-			break;
-	}
+	if(_ocore_hash_find(handle, new_name))
+		return NULL;
 
 	aux = _ocore_hash_extract(handle, old_name);
 	if(!aux)
 		return NULL;
 
-	if(node)
-		node->next = aux;
-	else 
-		handle->table[idx] = aux;
-
-	aux->next = NULL;
-
 	/* Finalmente el nuevo nombre */
 	if(aux->name_dup) {
 		free(aux->name);
 		aux->name = strdup(new_name);
 	} else
 		aux->name = (char *)new_name;
+	aux->hash = hash_func(new_name);
+
+	_ocore_hash_insert(handle, aux);
+	_ocore_hash_resize(handle);
 
 	return aux;
 }
 
 /* ocore_hash_list(): Permite recorrer la tabla con sus nodos.
  * ocore_hash_position es una estructura que contiene la ubicacion
- * actual en la tabla.
+ * actual en la tabla. Se sigue la lista en orden de insercion, que las
+ * redimensiones no tocan: cada nodo se visita una sola vez, y los que se
+ * agregan durante el recorrido tambien. Eliminar el nodo actual invalida el
+ * cursor. Un recorrido se puede dejar en cualquier momento.
  */
 ocore_hash_node *ocore_hash_list(ocore_hash *handle, ocore_hash_position *pst)
 {
-	if(!handle || !pst || pst->idx >= handle->size)
+	if(!handle || !pst || pst->idx)
 		return NULL;
 
-	if(pst->node)
-		pst->node = pst->node->next;
-	else
-		pst->node = handle->table[pst->idx];
-
-	if(!pst->node) {
-		while(++pst->idx < handle->size) {
-			pst->node = handle->table[pst->idx];
-			if(pst->node)
-				break;
-		}
-	}
+	pst->node = pst->node? pst->node->list_next : handle->first;
+	if(!pst->node)
+		pst->idx = 1;
 
 	return pst->node;
 }
@@ -246,41 +337,54 @@ ocore_hash_node *ocore_hash_list(ocore_hash *handle, ocore_hash_position *pst)
 void _ocore_hash_destroy_all(ocore_hash *handle)
 {
 	ocore_hash_node *node, *next;
-	unsigned int idx = 0;
+	ocore_hash_table *t;
+	unsigned int idx;
+	int i;
 
 	/* Manera rapida de acabar con todos los nodos hohoho.. */
-	while(idx < handle->size) {
-		node = handle->table[idx];
-		while(node != NULL) {
-			next = node->next;
-			if(handle->free_func && node->value)
-				handle->free_func(node->value);
-
-			if(node->name_dup)
-				free(node->name);
-
-			free(node);
-			node = next;
+	for(i = 0; i < 2; i++) {
+		t = &handle->tab[i];
+		for(idx = 0; idx < t->size; idx++) {
+			node = t->table[idx];
+			while(node != NULL) {
+				next = node->next;
+				if(handle->free_func && node->value)
+					handle->free_func(node->value);
+
+				if(node->name_dup)
+					free(node->name);
+
+				free(node);
+				node = next;
+			}
 		}
-
-		handle->table[idx++] = NULL;
+		free(t->table);
+		t->table = NULL;
+		t->size = 0;
 	}
+
+	handle->count = 0;
+	handle->rehash_idx = 0;
+	handle->first = NULL;
+	handle->last = NULL;
 }
 
 /* ocore_hash_destroy_all(): Libera todas las entradas de la tabla.
+ * La tabla vuelve a su tamano inicial.
  */
 void ocore_hash_destroy_all(ocore_hash *handle)
 {
-	if(handle && handle->table)
+	if(handle && handle->tab[0].table) {
 		_ocore_hash_destroy_all(handle);
+		handle->tab[0].table = _ocore_hash_alloc_table(handle->min_size);
+		handle->tab[0].size = handle->min_size;
+	}
 }
 
 /* ocore_hash_free_table(): Libera todas las entradas y la tabla.
 */
 void ocore_hash_free_table(ocore_hash *handle)
 {
-	if(handle && handle->table) {
+	if(handle && handle->tab[0].table)
 		_ocore_hash_destroy_all(handle);
-		free(handle->table);
-	}
 }
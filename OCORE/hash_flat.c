@@ -0,0 +1,531 @@
+/* Felipe Astroza 2006
+ * Ocore hash_flat.c
+ * Under GPL
+ */
+
+/* Motor alternativo para hash.h: direccionamiento abierto sobre arreglos
+ * planos. Cada slot tiene un byte de control (vacio, borrado o los 7 bits
+ * altos del hash) y se compara de a grupos de 16 con SSE2, asi una busqueda
+ * solo toca los nodos cuyo tag coincide. Los slots apuntan a nodos
+ * reservados aparte: un ocore_hash_node * sigue valido igual que con el
+ * motor encadenado.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <hash.h>
+
+#define CTRL_EMPTY	0x80
+#define CTRL_DELETED	0xFE
+#define GROUP		OCORE_HASH_FLAT_GROUP
+
+#define H2(h) ((unsigned char)((h) >> 25))
+
+static unsigned int hash_func(const char *name)
+{
+	const char *ptr = name;
+	unsigned int h = 0;
+
+	while(*ptr)
+		h = *ptr++ + (h << 5) - h;
+
+	/* Mezcla final, el grupo sale de los bits bajos y el tag de los altos */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/* group_match(): Mascara con un bit por cada byte de control igual a 'c'
+ */
+static inline unsigned int group_match(const unsigned char *ctrl, unsigned char c)
+{
+#ifdef __SSE2__
+	__m128i g = _mm_load_si128((const __m128i *)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+	unsigned int i, m = 0;
+
+	for(i = 0; i < GROUP; i++)
+		if(ctrl[i] == c)
+			m |= 1U << i;
+
+	return m;
+#endif
+}
+
+/* group_free(): Mascara de slots vacios o borrados (bit alto encendido)
+ */
+static inline unsigned int group_free(const unsigned char *ctrl)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+	unsigned int i, m = 0;
+
+	for(i = 0; i < GROUP; i++)
+		if(ctrl[i] & 0x80)
+			m |= 1U << i;
+
+	return m;
+#endif
+}
+
+static unsigned int _ocore_hash_round_size(unsigned int size)
+{
+	unsigned int s = GROUP;
+
+	while(s < size)
+		s <<= 1;
+
+	return s;
+}
+
+static void _ocore_hash_alloc_table(ocore_hash_table *t, unsigned int size)
+{
+	void *ctrl;
+
+	if(posix_memalign(&ctrl, GROUP, size) != 0) {
+		perror("posix_memalign");
+		exit(EXIT_FAILURE);
+	}
+	memset(ctrl, CTRL_EMPTY, size);
+
+	t->slots = calloc(size, sizeof(ocore_hash_node *));
+	if(!t->slots) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	t->ctrl = ctrl;
+	t->table = NULL;
+	t->size = size;
+	t->used = 0;
+	t->live = 0;
+}
+
+static void _ocore_hash_release_table(ocore_hash_table *t)
+{
+	free(t->ctrl);
+	free(t->slots);
+	memset(t, 0, sizeof(ocore_hash_table));
+}
+
+static ocore_hash_node **
+_ocore_hash_find_in(ocore_hash_table *t, const char *name, unsigned int h)
+{
+	unsigned int mask = t->size / GROUP - 1;
+	unsigned int g = h & mask, i, m;
+	unsigned char *ctrl;
+	ocore_hash_node *node;
+
+	for(i = 0; i <= mask; i++) {
+		ctrl = t->ctrl + g * GROUP;
+		for(m = group_match(ctrl, H2(h)); m; m &= m - 1) {
+			node = t->slots[g * GROUP + __builtin_ctz(m)];
+			if(node->hash == h && strcasecmp(name, node->name) == 0)
+				return &t->slots[g * GROUP + __builtin_ctz(m)];
+		}
+
+		if(group_match(ctrl, CTRL_EMPTY))
+			break;
+
+		/* Sondeo triangular, recorre todos los grupos */
+		g = (g + i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/* _ocore_hash_find(): Busca en ambas tablas, retorna el slot o NULL.
+ * 'tab_out' recibe la tabla donde se encontro.
+ */
+static ocore_hash_node **
+_ocore_hash_find(ocore_hash *handle, const char *name, ocore_hash_table **tab_out)
+{
+	ocore_hash_node **slot;
+	unsigned int h = hash_func(name);
+	int i;
+
+	for(i = 0; i < 2; i++) {
+		if(!handle->tab[i].size)
+			break;
+
+		slot = _ocore_hash_find_in(&handle->tab[i], name, h);
+		if(slot) {
+			if(tab_out)
+				*tab_out = &handle->tab[i];
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+/* _ocore_hash_slot(): Reserva un slot libre para un hash, sin verificar
+ * duplicados.
+ */
+static ocore_hash_node **_ocore_hash_slot(ocore_hash_table *t, unsigned int h)
+{
+	unsigned int mask = t->size / GROUP - 1;
+	unsigned int g = h & mask, i, m, idx;
+
+	for(i = 0; ; i++) {
+		m = group_free(t->ctrl + g * GROUP);
+		if(m) {
+			idx = g * GROUP + __builtin_ctz(m);
+			if(t->ctrl[idx] == CTRL_EMPTY)
+				t->used++;
+			t->live++;
+			t->ctrl[idx] = H2(h);
+			return &t->slots[idx];
+		}
+		g = (g + i + 1) & mask;
+	}
+}
+
+/* _ocore_hash_clear_slot(): Libera un slot. Si el grupo todavia tiene un slot
+ * vacio ningun sondeo paso de largo por el, y el slot puede quedar vacio.
+ */
+static void _ocore_hash_clear_slot(ocore_hash_table *t, ocore_hash_node **slot)
+{
+	unsigned int idx = slot - t->slots;
+	unsigned char *ctrl = t->ctrl + idx / GROUP * GROUP;
+
+	t->live--;
+	if(group_match(ctrl, CTRL_EMPTY)) {
+		t->ctrl[idx] = CTRL_EMPTY;
+		t->used--;
+	} else
+		t->ctrl[idx] = CTRL_DELETED;
+}
+
+static inline int _ocore_hash_full(ocore_hash_table *t)
+{
+	return t->used * 8 >= t->size * OCORE_HASH_FLAT_MAX_LOAD;
+}
+
+/* _ocore_hash_rehash_step(): Traslada hasta 'n' grupos de tab[0] a tab[1].
+ * Los slots trasladados quedan como borrados para no cortar los sondeos
+ * de los que aun no se trasladan.
+ */
+static void _ocore_hash_rehash_step(ocore_hash *handle, unsigned int n)
+{
+	ocore_hash_table *old = &handle->tab[0], *new = &handle->tab[1];
+	ocore_hash_node *node;
+	unsigned int end;
+
+	while(n-- && handle->rehash_idx < old->size) {
+		for(end = handle->rehash_idx + GROUP; handle->rehash_idx < end; handle->rehash_idx++) {
+			if(old->ctrl[handle->rehash_idx] & 0x80)
+				continue;
+
+			node = old->slots[handle->rehash_idx];
+			*_ocore_hash_slot(new, node->hash) = node;
+			old->ctrl[handle->rehash_idx] = CTRL_DELETED;
+			old->live--;
+		}
+	}
+
+	if(handle->rehash_idx >= old->size) {
+		_ocore_hash_release_table(old);
+		*old = *new;
+		memset(new, 0, sizeof(ocore_hash_table));
+		handle->rehash_idx = 0;
+	}
+}
+
+/* _ocore_hash_pace(): Grupos a trasladar en este paso. La tabla destino no
+ * debe llenarse antes de terminar: cada operacion ocupa a lo mas un slot, y
+ * los nodos que faltan trasladar ocupan el suyo. Normalmente es
+ * OCORE_HASH_REHASH_STEP.
+ */
+static unsigned int _ocore_hash_pace(ocore_hash *handle)
+{
+	ocore_hash_table *old = &handle->tab[0], *new = &handle->tab[1];
+	unsigned int left = (old->size - handle->rehash_idx) / GROUP;
+	unsigned int cap = new->size / 8 * OCORE_HASH_FLAT_MAX_LOAD, spare, n;
+
+	if(new->used + old->live >= cap)
+		return left;
+
+	spare = cap - new->used - old->live;
+	n = (left + spare - 1) / spare;
+
+	return n > OCORE_HASH_REHASH_STEP? n : OCORE_HASH_REHASH_STEP;
+}
+
+/* _ocore_hash_resize(): Igual que en el motor encadenado; ademas, si la tabla
+ * esta llena de borrados, la reconstruye con el mismo tamano.
+ */
+static void _ocore_hash_resize(ocore_hash *handle)
+{
+	ocore_hash_table *t = &handle->tab[0];
+	unsigned int size;
+
+	if(OCORE_HASH_RESIZING(handle)) {
+		_ocore_hash_rehash_step(handle, _ocore_hash_pace(handle));
+		if(OCORE_HASH_RESIZING(handle))
+			return;
+	}
+
+	size = t->size;
+	if(_ocore_hash_full(t)) {
+		if(handle->count * 2 >= size)
+			size *= 2;
+	} else if(size > handle->min_size && handle->count * OCORE_HASH_SHRINK_LOAD < size)
+		size /= 2;
+	else
+		return;
+
+	_ocore_hash_alloc_table(&handle->tab[1], size);
+	handle->rehash_idx = 0;
+	_ocore_hash_rehash_step(handle, OCORE_HASH_REHASH_STEP);
+}
+
+/* _ocore_hash_link(), _ocore_hash_unlink(): Como en el motor encadenado */
+static void _ocore_hash_link(ocore_hash *handle, ocore_hash_node *node)
+{
+	node->list_next = NULL;
+	node->list_prev = handle->last;
+	if(handle->last)
+		handle->last->list_next = node;
+	else
+		handle->first = node;
+	handle->last = node;
+}
+
+static void _ocore_hash_unlink(ocore_hash *handle, ocore_hash_node *node)
+{
+	if(node->list_prev)
+		node->list_prev->list_next = node->list_next;
+	else
+		handle->first = node->list_next;
+	if(node->list_next)
+		node->list_next->list_prev = node->list_prev;
+	else
+		handle->last = node->list_prev;
+}
+
+/* ocore_hash_init: Permite asignar la memoria requerida por la tabla
+ * y ajustar algunas opciones (size, free_value).
+ */
+void ocore_hash_init(ocore_hash *handle, unsigned int size, ocore_hash_free_func func)
+{
+	unsigned int _size = _ocore_hash_round_size(size? size : DEFAULT_HASHSIZE);
+
+	if(handle) {
+		memset(handle, 0, sizeof(ocore_hash));
+		_ocore_hash_alloc_table(&handle->tab[0], _size);
+		handle->min_size = _size;
+		handle->free_func = func;
+	}
+}
+
+/* ocore_hash_add(): Agrega un nuevo nodo a la hash table
+ */
+ocore_hash_node *
+ocore_hash_add(ocore_hash *handle, const char *name, void *value, int dup)
+{
+	ocore_hash_node *node;
+	unsigned int h;
+
+	if(!handle || !name)
+		return NULL;
+
+	if(_ocore_hash_find(handle, name, NULL))
+		return NULL;
+
+	node = malloc(sizeof(ocore_hash_node));
+	if(!node) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Primero se hace espacio en la tabla donde va el nodo */
+	_ocore_hash_resize(handle);
+
+	h = hash_func(name);
+	*_ocore_hash_slot(&handle->tab[OCORE_HASH_RESIZING(handle)? 1 : 0], h) = node;
+	node->name = dup? strdup(name) : (char *)name;
+	node->name_dup = dup;
+	node->value = value;
+	node->hash = h;
+	node->next = NULL;
+	_ocore_hash_link(handle, node);
+	handle->count++;
+
+	return node;
+}
+
+/* ocore_hash_get_node(): Retorna nodo buscado.
+ */
+ocore_hash_node *
+ocore_hash_get_node(ocore_hash *handle, const char *name)
+{
+	ocore_hash_node **slot;
+
+	if(!handle || !name)
+		return NULL;
+
+	slot = _ocore_hash_find(handle, name, NULL);
+	return slot? *slot : NULL;
+}
+
+/* ocore_hash_get_value(): Retorna el valor del nodo buscado
+ */
+void *ocore_hash_get_value(ocore_hash *handle, const char *name)
+{
+	ocore_hash_node **slot;
+
+	if(!handle || !name)
+		return NULL;
+
+	slot = _ocore_hash_find(handle, name, NULL);
+	return slot? (*slot)->value : NULL;
+}
+
+/* ocore_hash_count(): Retorna el numero de nodos
+ */
+unsigned int ocore_hash_count(ocore_hash *handle)
+{
+	return handle? handle->count : 0;
+}
+
+/* ocore_hash_remove(): Elimina nodo de la hash table.
+ */
+int ocore_hash_remove(ocore_hash *handle, const char *name)
+{
+	ocore_hash_node **slot, *node;
+	ocore_hash_table *t;
+
+	if(!handle || !name)
+		return 0;
+
+	slot = _ocore_hash_find(handle, name, &t);
+	if(!slot)
+		return 0;
+
+	node = *slot;
+	if(handle->free_func && node->value)
+		handle->free_func(node->value);
+
+	if(node->name_dup)
+		free(node->name);
+
+	_ocore_hash_clear_slot(t, slot);
+	_ocore_hash_unlink(handle, node);
+	free(node);
+	handle->count--;
+	_ocore_hash_resize(handle);
+	return 1;
+}
+
+/* ocore_hash_change_key(): Reubica el nodo con su nueva llave.
+ */
+ocore_hash_node *
+ocore_hash_change_key(ocore_hash *handle, const char *old_name, const char *new_name)
+{
+	ocore_hash_node **slot, *node;
+	ocore_hash_table *t;
+
+	if(!handle || !old_name || !new_name)
+		return NULL;
+
+	if(_ocore_hash_find(handle, new_name, NULL))
+		return NULL;
+
+	slot = _ocore_hash_find(handle, old_name, &t);
+	if(!slot)
+		return NULL;
+
+	node = *slot;
+	_ocore_hash_clear_slot(t, slot);
+	_ocore_hash_resize(handle);
+
+	/* Finalmente el nuevo nombre */
+	if(node->name_dup) {
+		free(node->name);
+		node->name = strdup(new_name);
+	} else
+		node->name = (char *)new_name;
+	node->hash = hash_func(new_name);
+
+	*_ocore_hash_slot(&handle->tab[OCORE_HASH_RESIZING(handle)? 1 : 0], node->hash) = node;
+
+	return node;
+}
+
+/* ocore_hash_list(): Permite recorrer la tabla con sus nodos. Igual que en
+ * el motor encadenado, se sigue la lista en orden de insercion.
+ */
+ocore_hash_node *ocore_hash_list(ocore_hash *handle, ocore_hash_position *pst)
+{
+	if(!handle || !pst || pst->idx)
+		return NULL;
+
+	pst->node = pst->node? pst->node->list_next : handle->first;
+	if(!pst->node)
+		pst->idx = 1;
+
+	return pst->node;
+}
+
+static void _ocore_hash_destroy_all(ocore_hash *handle)
+{
+	ocore_hash_node *node;
+	ocore_hash_table *t;
+	unsigned int idx;
+	int i;
+
+	for(i = 0; i < 2; i++) {
+		t = &handle->tab[i];
+		for(idx = 0; idx < t->size; idx++) {
+			if(t->ctrl[idx] & 0x80)
+				continue;
+
+			node = t->slots[idx];
+			if(handle->free_func && node->value)
+				handle->free_func(node->value);
+
+			if(node->name_dup)
+				free(node->name);
+			free(node);
+		}
+		_ocore_hash_release_table(t);
+	}
+
+	handle->count = 0;
+	handle->rehash_idx = 0;
+	handle->first = NULL;
+	handle->last = NULL;
+}
+
+/* ocore_hash_destroy_all(): Libera todas las entradas de la tabla.
+ * La tabla vuelve a su tamano inicial.
+ */
+void ocore_hash_destroy_all(ocore_hash *handle)
+{
+	if(handle && handle->tab[0].ctrl) {
+		_ocore_hash_destroy_all(handle);
+		_ocore_hash_alloc_table(&handle->tab[0], handle->min_size);
+	}
+}
+
+/* ocore_hash_free_table(): Libera todas las entradas y la tabla.
+*/
+void ocore_hash_free_table(ocore_hash *handle)
+{
+	if(handle && handle->tab[0].ctrl)
+		_ocore_hash_destroy_all(handle);
+}
@@ -0,0 +1,320 @@
+/* Felipe Astroza 2006
+ * Ocore lz.c
+ * Under GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lz.h>
+
+/* Tabla de la ultima posicion de cada hash de 4 bytes */
+#define LZ_HASH_LOG	13
+/* Cada 64 intentos sin coincidencia el paso crece en 1 */
+#define LZ_SKIP_LOG	6
+
+/* Largo de los segmentos que cuenta ocore_lz_train() */
+#define LZ_SEGMENT	32
+
+static unsigned int _lz_read32(const unsigned char *p)
+{
+	unsigned int v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static unsigned int _lz_hash(unsigned int v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+/* _lz_put_len(): Resto de un largo, en bytes de 255 */
+static unsigned char *_lz_put_len(unsigned char *op, unsigned char *oend, size_t len)
+{
+	for(; len >= 255; len -= 255) {
+		if(op >= oend)
+			return NULL;
+		*op++ = 255;
+	}
+	if(op >= oend)
+		return NULL;
+	*op++ = len;
+
+	return op;
+}
+
+/* _lz_sequence(): Escribe una secuencia. 'mlen' 0 es la ultima, sin
+ * coincidencia. Retorna NULL si no cabe.
+ */
+static unsigned char *_lz_sequence(unsigned char *op, unsigned char *oend,
+	const unsigned char *lit, size_t litlen, size_t off, size_t mlen)
+{
+	unsigned char *token;
+
+	if(op >= oend)
+		return NULL;
+
+	token = op++;
+	*token = (litlen >= 15? 15 : litlen) << 4;
+	if(litlen >= 15 && !(op = _lz_put_len(op, oend, litlen - 15)))
+		return NULL;
+	if(litlen > (size_t)(oend - op))
+		return NULL;
+	memcpy(op, lit, litlen);
+	op += litlen;
+
+	if(mlen == 0)
+		return op;
+
+	if(oend - op < 2)
+		return NULL;
+	*op++ = off & 0xff;
+	*op++ = off >> 8;
+
+	mlen -= OCORE_LZ_MINMATCH;
+	*token |= mlen >= 15? 15 : mlen;
+	if(mlen >= 15 && !(op = _lz_put_len(op, oend, mlen - 15)))
+		return NULL;
+
+	return op;
+}
+
+/* _lz_compress(): Comprime base[start, end). Lo anterior a 'start' es el
+ * diccionario.
+ */
+static size_t _lz_compress(const unsigned char *base, size_t start, size_t end,
+	unsigned char *dst, size_t cap)
+{
+	unsigned int table[1 << LZ_HASH_LOG];
+	unsigned char *op = dst, *oend = dst + cap;
+	size_t ip, anchor = start, ref, len;
+	unsigned int h;
+
+	memset(table, 0, sizeof(table));
+
+	/* Las posiciones se guardan + 1, 0 es vacio */
+	for(ip = 0; ip < start && ip + OCORE_LZ_MINMATCH <= end; ip++)
+		table[_lz_hash(_lz_read32(base + ip))] = ip + 1;
+
+	ip = start;
+	while(ip + OCORE_LZ_MINMATCH <= end) {
+		h = _lz_hash(_lz_read32(base + ip));
+		ref = table[h];
+		table[h] = ip + 1;
+
+		if(ref && ip - (ref - 1) <= OCORE_LZ_WINDOW &&
+		   _lz_read32(base + ref - 1) == _lz_read32(base + ip)) {
+			ref--;
+			for(len = OCORE_LZ_MINMATCH; ip + len < end && base[ref + len] == base[ip + len]; len++)
+				;
+
+			if(!(op = _lz_sequence(op, oend, base + anchor, ip - anchor, ip - ref, len)))
+				return 0;
+			ip += len;
+			anchor = ip;
+		} else
+			ip += 1 + ((ip - anchor) >> LZ_SKIP_LOG);
+	}
+
+	if(!(op = _lz_sequence(op, oend, base + anchor, end - anchor, 0, 0)))
+		return 0;
+
+	return op - dst;
+}
+
+/* ocore_lz_compress(): Comprime 'n' bytes de 'src' en 'dst'. Retorna el
+ * tamano comprimido, o 0 si no cabe en 'cap' bytes.
+ */
+size_t ocore_lz_compress(const void *src, size_t n, void *dst, size_t cap,
+	const void *dict, size_t dictlen)
+{
+	unsigned char *buf;
+	size_t ret;
+
+	/* Las posiciones de la tabla son de 32 bits */
+	if(n == 0 || n > 0x7fffffff)
+		return 0;
+
+	if(!dict || dictlen == 0)
+		return _lz_compress(src, 0, n, dst, cap);
+
+	if(dictlen > OCORE_LZ_WINDOW) {
+		dict = (const unsigned char *)dict + dictlen - OCORE_LZ_WINDOW;
+		dictlen = OCORE_LZ_WINDOW;
+	}
+
+	/* El diccionario queda justo antes de los datos */
+	buf = malloc(dictlen + n);
+	if(!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(buf, dict, dictlen);
+	memcpy(buf + dictlen, src, n);
+
+	ret = _lz_compress(buf, dictlen, dictlen + n, dst, cap);
+	free(buf);
+
+	return ret;
+}
+
+/* _lz_get_len(): Lee el resto de un largo. Retorna 0 si 'src' se acaba.
+ */
+static int _lz_get_len(const unsigned char **ip, const unsigned char *iend, size_t *len)
+{
+	unsigned char b;
+
+	do {
+		if(*ip >= iend)
+			return 0;
+		b = *(*ip)++;
+		*len += b;
+	} while(b == 255);
+
+	return 1;
+}
+
+/* ocore_lz_decompress(): Descomprime 'n' bytes de 'src' en 'dst'. Retorna el
+ * tamano descomprimido, o 0 si los datos no son validos o no caben en 'cap'.
+ */
+size_t ocore_lz_decompress(const void *src, size_t n, void *dst, size_t cap,
+	const void *dict, size_t dictlen)
+{
+	const unsigned char *ip = src, *iend = ip + n, *d = dict, *from;
+	unsigned char *op = dst, *oend = op + cap;
+	size_t lit, mlen, off, back, k;
+	unsigned char token;
+
+	while(ip < iend) {
+		token = *ip++;
+
+		lit = token >> 4;
+		if(lit == 15 && !_lz_get_len(&ip, iend, &lit))
+			return 0;
+		if(lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+			return 0;
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+
+		if(ip == iend)
+			break;
+
+		if(iend - ip < 2)
+			return 0;
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		mlen = token & 15;
+		if(mlen == 15 && !_lz_get_len(&ip, iend, &mlen))
+			return 0;
+		mlen += OCORE_LZ_MINMATCH;
+
+		if(off == 0 || mlen > (size_t)(oend - op))
+			return 0;
+
+		/* Antes del comienzo de 'dst' sigue el final del diccionario */
+		if(off > (size_t)(op - (unsigned char *)dst)) {
+			back = off - (op - (unsigned char *)dst);
+			if(!d || back > dictlen)
+				return 0;
+			for(k = 0; k < back && mlen; k++, mlen--)
+				*op++ = d[dictlen - back + k];
+		}
+
+		from = op - off;
+		if(off >= mlen) {
+			memcpy(op, from, mlen);
+			op += mlen;
+		} else
+			while(mlen--)
+				*op++ = *from++;
+	}
+
+	return op - (unsigned char *)dst;
+}
+
+typedef struct {
+	unsigned int hash;
+	unsigned int count;
+	const unsigned char *seg;
+} _lz_segment;
+
+static unsigned int _lz_seg_hash(const unsigned char *p)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for(i = 0; i < LZ_SEGMENT; i++)
+		h = (h ^ p[i]) * 16777619U;
+
+	return h | 1;
+}
+
+static int _lz_seg_cmp(const void *a, const void *b)
+{
+	const _lz_segment *x = a, *y = b;
+
+	return x->count < y->count? 1 : x->count > y->count? -1 : 0;
+}
+
+/* ocore_lz_train(): Arma un diccionario de hasta 'cap' bytes con los
+ * segmentos que mas se repiten en las muestras. Los mas frecuentes quedan
+ * al final, donde los offsets son menores. Retorna el tamano.
+ */
+size_t ocore_lz_train(const void **samples, const size_t *sizes, int n, void *dict, size_t cap)
+{
+	_lz_segment *table;
+	const unsigned char *p;
+	unsigned int size = 1024, mask, h, i, used = 0;
+	size_t total = 0, pos, len = 0;
+	int s;
+
+	for(s = 0; s < n; s++)
+		total += sizes[s] / (LZ_SEGMENT / 2);
+
+	while(size < total * 2 && size < (1 << 22))
+		size *= 2;
+	mask = size - 1;
+
+	table = calloc(size, sizeof(_lz_segment));
+	if(!table) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Segmentos que se traslapan a la mitad */
+	for(s = 0; s < n; s++) {
+		p = samples[s];
+		for(pos = 0; pos + LZ_SEGMENT <= sizes[s]; pos += LZ_SEGMENT / 2) {
+			h = _lz_seg_hash(p + pos);
+			for(i = h & mask; table[i].hash && table[i].hash != h; i = (i + 1) & mask)
+				;
+			if(!table[i].hash) {
+				if(used * 4 >= size * 3)
+					continue;
+				table[i].hash = h;
+				table[i].seg = p + pos;
+				used++;
+			}
+			table[i].count++;
+		}
+	}
+
+	/* Los que se repiten, de mas a menos frecuente */
+	for(i = 0, used = 0; i < size; i++)
+		if(table[i].count > 1)
+			table[used++] = table[i];
+	qsort(table, used, sizeof(_lz_segment), _lz_seg_cmp);
+
+	for(i = 0; i < used && len + LZ_SEGMENT <= cap; i++) {
+		memcpy((unsigned char *)dict + cap - len - LZ_SEGMENT, table[i].seg, LZ_SEGMENT);
+		len += LZ_SEGMENT;
+	}
+	memmove(dict, (unsigned char *)dict + cap - len, len);
+
+	free(table);
+	return len;
+}
@@ -19,31 +19,128 @@
 #include <sys/stat.h>  
 #include <fcntl.h>
 #include <assert.h>
+#include <ctype.h>
 #define __USE_GNU
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <signal.h>
 
-#include <hash.h>
 #include <ofile.h>
+#include <lz.h>
+#include <crc32c.h>
+#include <uring.h>
 
-static void load_file(o_file *);
+static void o_index_rebuild(o_file *);
+static void o_stream_reap(o_file *);
+static void o_priv_build(o_file *);
 static int o_get_flags(const char *);
-
-#define OFILE_SIZE(a) (((o_file_header *)(a)->mapped.base)->f_size)
+static int o_get_opts(const char *);
+static void o_begin(o_file *);
+static void o_end(o_file *);
+static long o_read_begin(o_file *);
+static void o_read_end(o_file *);
+static void o_mremap(o_file *, size_t);
+static void o_map_advise(o_file *, size_t);
+static o_window *o_win_find(o_file *, off_t, size_t);
+static void *o_win_get(o_file *, off_t, size_t);
+static void o_win_put(o_file *, const void *);
+static void o_mlock_update(o_file *);
+static void o_compact_auto(o_file *);
+static off_t o_reserve(o_file *, const char *, o_metadata *);
+static void o_delete(o_file *, off_t);
+static void o_free_add(o_file *, off_t, size_t);
+static void o_commit_done(o_file *);
+static void o_verified_reset(o_file *);
+static void o_verified_clear(o_file *, off_t, size_t);
+static void *o_commit_thread(void *);
+
+/* Un fichero del formato 1 abierto para leer usa una cabecera propia */
+#define OHEADER(a) ((a)->v1? (a)->v1 : (o_file_header *)(a)->mapped.base)
+#define OFILE_SIZE(a) (OHEADER(a)->f_size)
 #define OADDR(a, b) ( (caddr_t)(a)->mapped.base + (b) )
+#define OMAPPED(a) ((size_t)(a)->mapped.pages * (a)->pagsize)
+
+/* Copia de la metadata de una entrada, y donde quedan su nombre y sus
+ * datos. Los lectores solo usan la copia, revisada una vez: en modo
+ * compartido otro proceso puede cambiar la metadata mientras se lee, y
+ * aunque o_read_retry() descarte lo leido, nada se puede leer fuera de la
+ * memoria mapeada antes.
+ */
+typedef struct {
+	o_metadata md;
+	caddr_t head; /* la metadata en la memoria mapeada, o en una ventana */
+	caddr_t name;
+	caddr_t data;
+} o_entry_view;
+
+/* Un hueco libre es una entrada eliminada con nombre vacio. Sus datos
+ * guardan los enlaces de la lista de su clase.
+ */
+typedef struct {
+	int64_t next;
+	int64_t prev;
+} o_free_link;
+
+#define OFREE(a, b) ((o_free_link *)OADDR(a, (b) + sizeof(o_metadata) + 1))
+/* Menor entrada eliminada posible, y menor hueco que se puede enlazar */
+#define O_DEAD_MIN	(sizeof(o_metadata) + 1)
+#define O_FREE_MIN	(O_DEAD_MIN + sizeof(o_free_link))
+/* Huecos revisados por clase antes de pasar a la siguiente */
+#define O_FREE_SCAN	8
+
+/* Los slots del indice quedan alineados dentro de su entrada, ningun slot
+ * cruza una linea de cache.
+ */
+#define O_INDEX_ALIGN	16
+#define O_INDEX_AT(a, b) \
+	((o_index_slot *)OADDR(a, ((b) + O_DEAD_MIN + O_INDEX_ALIGN - 1) & ~(off_t)(O_INDEX_ALIGN - 1)))
 
 /* Obtiene el numero de paginas */
-static inline int PAGES(int pagsize, int size)
+static inline size_t PAGES(int pagsize, size_t size)
 {
 	return (size % pagsize) != 0? (size / pagsize) + 1 : size / pagsize;
 }
 
 #define OFILE_PAGES(a) PAGES((a)->pagsize, OFILE_SIZE((a)))
+#define OFILE_CAPACITY(a) (OHEADER(a)->capacity)
+
+static const o_file_header orix_file_header_ = {{'O', 'F', 'L'}, O_VERSION, O_HEADERSIZE, O_HEADERSIZE, 0, O_HEADERSIZE, {0}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-static const char orix_file_header_[] = {'O', 'F', 'L', 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
+/* Formato 1, el original: la cabecera, y las entradas una tras otra sin
+ * huecos, cada una con esta metadata, el nombre y los datos.
+ */
+typedef struct {
+	char fn[3];
+	size_t f_size;
+	int num;
+} o_v1_header;
+
+typedef struct {
+	size_t size;
+	size_t namelen;
+} o_v1_metadata;
+
+/* Un fichero del formato 1 abierto para escribir se convierte en este y
+ * luego reemplaza al original
+ */
+#define O_UPGRADE_SUFFIX	".upgrade"
+
+/* Abierto para leer se lee tal cual: la primera entrada y el nombre de
+ * cada una dependen del formato
+ */
+#define O_FIRST(a) ((a)->v1? sizeof(o_v1_header) : O_HEADERSIZE)
+#define O_MDSIZE(a) ((a)->v1? sizeof(o_v1_metadata) : sizeof(o_metadata))
 
-/* Abre un OrixFile. Se devuelve el puntero de una estructura o_file, la cual contiene el file descriptor, cabezera y una tabla hash
-   Si el fichero no es nuevo, y contiene datos, se agregan a la tabla hash cada nodo con la informacion de un dato (nombre, offset y size) */
+static int o_format(const char *, int, int, struct stat *, o_file_header **);
+
+/* Abre un OrixFile. Se devuelve el puntero de una estructura o_file, la cual contiene el file descriptor y la cabezera mapeada.
+   El indice de nombres esta en el mismo fichero, solo se reconstruye si falta o quedo a medio modificar */
 o_file *o_open(const char *file, const char *mode)
 {
 	int fd;
@@ -51,12 +148,16 @@ o_file *o_open(const char *file, const char *mode)
 	struct stat st;
 	void *addr;
 	o_file_header *header;
+	o_file_header *v1 = NULL;
 	int flags;
 	int prot = 0;
 	int pagsize;
 	int zero;
+	int mflags = MAP_SHARED;
+	int window;
 
 	flags = o_get_flags(mode);
+	window = o_get_opts(mode) & O_OPT_WINDOW;
 
 	if(flags == O_RDONLY)
 		prot = PROT_READ;
@@ -69,41 +170,59 @@ o_file *o_open(const char *file, const char *mode)
 		printf("%s(): creating new OrixFile\n", __FUNCTION__);
 		zero = 1;
 	} else {
-		if(st.st_size < O_HEADERSIZE) {
+		if(st.st_size < sizeof(o_v1_header)) {
 			printf("%s(): error: file format is not Orix File\n", __FUNCTION__);
 			return NULL;
 		}
 		zero = 0;
 	}
+	/* Los escritores necesitan todo el fichero mapeado */
+	if(window && ((flags & O_RDWR) || (o_get_opts(mode) & O_OPT_SHARED))) {
+		printf("%s(): error: windowed mapping is read only\n", __FUNCTION__);
+		return NULL;
+	}
 	if( (fd = open(file, flags, st.st_mode)) < 0) {
 		perror("open");
 		return NULL;
 	}
 	if(zero) {
-		if(write(fd, orix_file_header_, O_HEADERSIZE) == -1) {
+		if(write(fd, &orix_file_header_, O_HEADERSIZE) == -1) {
 			close(fd);
 			return NULL;
 		}
 		st.st_size =  O_HEADERSIZE;
-	}
+	} else if( (fd = o_format(file, fd, flags, &st, &v1)) < 0)
+		return NULL;
 
 	pagsize = getpagesize();
-	addr = mmap(0, PAGES(pagsize, st.st_size) * pagsize, prot, MAP_SHARED, fd, 0);
+#ifdef MAP_POPULATE
+	if(o_get_opts(mode) & O_OPT_POPULATE)
+		mflags |= MAP_POPULATE;
+#endif
+	/* Con ventanas solo la cabecera queda mapeada todo el tiempo */
+	addr = mmap(0, PAGES(pagsize, window? O_HEADERSIZE : st.st_size) * pagsize, prot, mflags, fd, 0);
 	if( addr == (void *) -1 ) {
 		perror("mmap");
 		return NULL;
 	}
-	header = addr;
-	if(zero == 0) {
-		if(strncmp(header->fn, "OFL", 3)!=0) {
-			close(fd);
-			printf("%s(): error: file format is not Orix File\n", __FUNCTION__);
-			munmap(header, O_HEADERSIZE);
-			return NULL;
-		}
-	} else
+	header = v1? v1 : addr;
+	if(zero)
 		header->f_size = O_HEADERSIZE;
 
+	/* El espacio reservado es todo el fichero. En modo compartido otro
+	 * proceso puede estar escribiendo, lo mantienen los escritores.
+	 */
+	if((prot & PROT_WRITE) && !(o_get_opts(mode) & O_OPT_SHARED)) {
+		header->capacity = st.st_size;
+		/* Escritores por partes que no terminaron, su espacio se libera
+		 * al reconstruir el indice
+		 */
+		if(header->streams) {
+			header->streams = 0;
+			header->dirty = 1;
+		}
+	}
+
 	if(!(of = calloc(1, sizeof(o_file)))) {
 		perror("calloc");
 		exit(EXIT_FAILURE);
@@ -111,18 +230,244 @@ o_file *o_open(const char *file, const char *mode)
 
 	of->mapped.base = addr;
 	of->pagsize = pagsize;
-	of->mapped.pages = OFILE_PAGES(of);
+	of->mapped.pages = PAGES(pagsize, window? O_HEADERSIZE : st.st_size);
 	of->mapped.prot = prot;
 	of->fd = fd;
 	of->flags = flags;
+	of->opts = o_get_opts(mode);
+	/* Nadie escribe un fichero del formato 1, los escritores lo convierten */
+	if((of->v1 = v1))
+		of->opts &= ~O_OPT_SHARED;
+	o_map_advise(of, 0);
+
+	pthread_mutex_init(&of->lock, NULL);
+	pthread_mutex_init(&of->commit.mutex, NULL);
+	pthread_mutex_init(&of->verify.mutex, NULL);
+	pthread_mutex_init(&of->aio.mutex, NULL);
+	of->aio.ring.fd = -1;
+	pthread_mutex_init(&of->win.mutex, NULL);
+	pthread_mutex_init(&of->zdict.mutex, NULL);
+	pthread_rwlock_init(&of->mapped.lock, NULL);
+	if(window) {
+		of->win.max = OFILE_WINDOWS;
+		of->win.fsize = st.st_size;
+		if(!(of->win.w = calloc(OFILE_WINDOWS, sizeof(o_window)))) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	pthread_cond_init(&of->commit.done, NULL);
+	pthread_cond_init(&of->commit.kick, NULL);
+	if((of->opts & O_OPT_GROUP) && (flags & O_RDWR)) {
+		of->commit.running = 1;
+		if(pthread_create(&of->commit.thread, NULL, o_commit_thread, of) != 0) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
 
-	ocore_hash_init(&of->hash, OFILE_HASHSIZE, NULL);
-	if(header->num > 0)
-		load_file(of);
+	/* o_begin() reconstruye el indice si hace falta. En modo compartido
+	 * se recuentan los escritores por partes, ver o_stream_reap().
+	 */
+	if(flags & O_RDWR) {
+		o_begin(of);
+		if((of->opts & O_OPT_SHARED) && OHEADER(of)->streams)
+			o_stream_reap(of);
+		o_end(of);
+	} else if(of->opts & O_OPT_SHARED) {
+		if(o_read_begin(of) < 0)
+			o_priv_build(of);
+		else {
+			o_read_end(of);
+			if(OHEADER(of)->index == 0)
+				o_priv_build(of);
+		}
+	} else if(header->index == 0 || header->dirty)
+		o_priv_build(of);
+	of->gen = OHEADER(of)->gen;
+	of->verify.gen = OHEADER(of)->gen;
+	o_mlock_update(of);
 
 	return of;
 }
 
+/* o_upgrade(): Convierte un fichero del formato 1 al actual. Las entradas
+ * se copian con su CRC, el indice se arma al abrir. El nuevo se crea junto
+ * al original y lo reemplaza. Las entradas deben llegar justo hasta f_size:
+ * si no, no es del formato 1 (ver O_VERSION) y no se toca. Abierto para
+ * leer no se convierte: en '*v1' queda una cabecera del formato actual que
+ * lo describe, y se lee tal cual. Retorna el descriptor del fichero
+ * convertido (o el original), o -1.
+ */
+static int o_upgrade(const char *file, int fd, int flags, struct stat *st, o_file_header **v1)
+{
+	o_file_header header = orix_file_header_;
+	o_v1_header *old;
+	o_v1_metadata *omd;
+	o_metadata md;
+	caddr_t base;
+	size_t pos, len;
+	off_t offset;
+	ssize_t n;
+	uint64_t num;
+	char *tmp = NULL;
+	int nfd = -1;
+
+	base = mmap(0, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+	old = (o_v1_header *)base;
+	if(old->f_size < sizeof(o_v1_header) || old->f_size > (size_t)st->st_size) {
+		printf("%s(): error: file format is not Orix File\n", __FUNCTION__);
+		goto out;
+	}
+
+	/* 'num' de la cabecera no es confiable, las entradas llegan hasta f_size */
+	for(pos = sizeof(o_v1_header); pos + sizeof(o_v1_metadata) <= old->f_size; ) {
+		omd = (o_v1_metadata *)(base + pos);
+		len = old->f_size - pos - sizeof(o_v1_metadata);
+		if(omd->namelen >= len || omd->size > len - omd->namelen - 1 ||
+		   base[pos + sizeof(o_v1_metadata) + omd->namelen] != '\0')
+			break;
+		pos += sizeof(o_v1_metadata) + omd->namelen + 1 + omd->size;
+	}
+	if(pos != old->f_size) {
+		printf("%s(): error: not a version 1 Orix File (bad entry at %lu)\n", __FUNCTION__, (unsigned long)pos);
+		goto out;
+	}
+
+	/* Leer no escribe nada, ni una copia */
+	if(!(flags & O_RDWR)) {
+		if(!(*v1 = malloc(O_HEADERSIZE))) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		**v1 = orix_file_header_;
+		(*v1)->f_size = old->f_size;
+		(*v1)->capacity = old->f_size;
+		munmap(base, st->st_size);
+		return fd;
+	}
+
+	if(!(tmp = malloc(strlen(file) + sizeof(O_UPGRADE_SUFFIX)))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(tmp, "%s%s", file, O_UPGRADE_SUFFIX);
+	if((nfd = open(tmp, O_RDWR|O_CREAT|O_TRUNC, st->st_mode & 0777)) < 0) {
+		perror("open");
+		goto out;
+	}
+
+	pos = sizeof(o_v1_header);
+	offset = O_HEADERSIZE;
+	for(num = 0; pos < old->f_size; num++) {
+		omd = (o_v1_metadata *)(base + pos);
+		md.size = omd->size;
+		md.namelen = omd->namelen;
+		md.crc = ocore_crc32c(0, base + pos + sizeof(o_v1_metadata) + omd->namelen + 1, omd->size);
+		md.reserved = 0;
+		if(pwrite(nfd, &md, sizeof(o_metadata), offset) != sizeof(o_metadata))
+			goto fail;
+		offset += sizeof(o_metadata);
+
+		/* El nombre y los datos, en partes si write() no los escribe enteros */
+		len = omd->namelen + 1 + omd->size;
+		pos += sizeof(o_v1_metadata);
+		while(len > 0) {
+			if((n = pwrite(nfd, base + pos, len, offset)) <= 0)
+				goto fail;
+			pos += n;
+			offset += n;
+			len -= n;
+		}
+	}
+
+	header.f_size = offset;
+	header.capacity = offset;
+	header.num = num;
+	if(pwrite(nfd, &header, O_HEADERSIZE, 0) != O_HEADERSIZE)
+		goto fail;
+
+	if(fsync(nfd) == -1 || rename(tmp, file) == -1)
+		goto fail;
+	free(tmp);
+	munmap(base, st->st_size);
+	close(fd);
+	st->st_size = offset;
+
+	return nfd;
+
+fail:
+	perror("o_upgrade");
+	close(nfd);
+	unlink(tmp);
+out:
+	free(tmp);
+	munmap(base, st->st_size);
+	close(fd);
+	return -1;
+}
+
+/* o_format(): Revisa el formato del fichero abierto en 'fd'. El formato 1
+ * se convierte con o_upgrade(), o se lee tal cual. Retorna el descriptor que se usa, o -1 (y
+ * 'fd' queda cerrado).
+ */
+static int o_format(const char *file, int fd, int flags, struct stat *st, o_file_header **v1)
+{
+	o_file_header header;
+	ssize_t n;
+
+	n = pread(fd, &header, O_HEADERSIZE, 0);
+	if(n < (ssize_t)sizeof(o_v1_header) || strncmp(header.fn, "OFL", 3) != 0) {
+		printf("%s(): error: file format is not Orix File\n", __FUNCTION__);
+		close(fd);
+		return -1;
+	}
+
+	if(header.version == 0)
+		return o_upgrade(file, fd, flags, st, v1);
+
+	if(header.version != O_VERSION || n != O_HEADERSIZE || header.hsize != O_HEADERSIZE) {
+		printf("%s(): error: unsupported Orix File version %d\n", __FUNCTION__, header.version);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int o_get_opts(const char *m)
+{
+	int opts = 0;
+
+	if(m && strchr(m, OF_SHARED))
+		opts |= O_OPT_SHARED;
+	if(m && strchr(m, OF_SYNC))
+		opts |= O_OPT_SYNC;
+	else if(m && strchr(m, OF_GROUP))
+		opts |= O_OPT_GROUP;
+	if(m && strchr(m, OF_COMPRESS))
+		opts |= O_OPT_COMPRESS;
+	if(m && strchr(m, OF_POPULATE))
+		opts |= O_OPT_POPULATE;
+	if(m && strchr(m, OF_HUGEPAGE))
+		opts |= O_OPT_HUGEPAGE;
+	if(m && strchr(m, OF_MLOCK))
+		opts |= O_OPT_MLOCK;
+	if(m && strchr(m, OF_WINDOW))
+		opts |= O_OPT_WINDOW;
+	if(m && strchr(m, OF_RANDOM))
+		opts |= O_OPT_RANDOM;
+	else if(m && strchr(m, OF_SEQUENTIAL))
+		opts |= O_OPT_SEQUENTIAL;
+
+	return opts;
+}
+
 static int o_get_flags(const char *m) 
 {
 	int flags = 0;
@@ -150,340 +495,3470 @@ static int o_get_flags(const char *m)
 	return flags;
 }
 
-/* load_file(): Registra las entradas existentes en el fichero
-*/
-static void load_file(o_file *of)
+/* o_hash(): Hash del nombre sin distinguir mayusculas, igual que strcasecmp()
+ */
+static unsigned int o_hash(const char *name)
 {
-	char *name;
-	off_t offset = O_HEADERSIZE;
-	size_t sz = OFILE_SIZE(of);
-	o_metadata *md;
-	int num = ((o_file_header *)of->mapped.base)->num;
+	unsigned int h = 2166136261U;
 
-        while ( sz > offset && num > 0 ) {
+	while(*name)
+		h = (h ^ (unsigned char)tolower((unsigned char)*name++)) * 16777619U;
 
-		md = (o_metadata *)OADDR(of, offset);
-		name = (char *)OADDR(of, offset + sizeof(o_metadata));
+	return h;
+}
 
-		if(!ocore_hash_add(&of->hash, name, (void *)offset, 0))
-			fprintf(stderr, "%s():\"%s\" already exists\n", __FUNCTION__, name);
+static o_index_slot *o_index(o_file *of)
+{
+	return of->priv.slots? of->priv.slots : O_INDEX_AT(of, OHEADER(of)->index);
+}
 
-							   /* size of data */
-		offset += sizeof(o_metadata) + O_NAMESIZE(md) + md->size;
-		num--;
-	}
+static unsigned int o_index_size(o_file *of)
+{
+	return of->priv.slots? of->priv.size : OHEADER(of)->index_size;
 }
 
-static void o_update_offset(o_file *of, int since, int adjust)
+static void o_entry_put(o_file *of, o_entry_view *e)
 {
-	ocore_hash_position pst;
-	ocore_hash_node *node;
+	if(of->win.max)
+		o_win_put(of, e->head);
+}
 
-	pst.node = NULL;
-	pst.idx = 0;
+/* o_entry_len(): Bytes que ocupa en el fichero la entrada de 'e' */
+static size_t o_entry_len(const o_entry_view *e)
+{
+	return (e->data - e->head) + e->md.size;
+}
 
-	while( (node = ocore_hash_list(&of->hash, &pst)) ) {
-		if(node->value == NULL)
-			continue;
+/* o_entry_head(): Copia en 'e' la metadata de la entrada en 'offset', si
+ * ella y el nombre estan dentro del fichero. Con ventanas queda fijada
+ * hasta o_entry_put(). Retorna 0 si no.
+ */
+static int o_entry_head(o_file *of, off_t offset, o_entry_view *e)
+{
+	size_t limit = of->win.max? of->win.fsize : OMAPPED(of), namesize;
+	size_t mdsize = O_MDSIZE(of);
 
-		if((off_t)node->value > since)
-			*((off_t *)&node->value) -= (off_t)adjust;
+	if(offset < O_FIRST(of) || offset + mdsize > limit)
+		return 0;
 
-		/* De todas formas actualizamos el miembro 'name', por si base cambia de valor */
-		node->name = OADDR(of, (off_t)node->value + sizeof(o_metadata));
+	if(!of->win.max)
+		e->head = OADDR(of, offset);
+	else if(!(e->head = o_win_get(of, offset, mdsize)))
+		return 0;
+	/* La metadata del formato 1 es el comienzo de la actual, sin CRC */
+	memset(&e->md, 0, sizeof(o_metadata));
+	memcpy(&e->md, e->head, mdsize);
 
+	namesize = O_NAMESIZE(&e->md);
+	if(namesize > limit - offset - mdsize) {
+		o_entry_put(of, e);
+		return 0;
 	}
-}
-
-static void o_mremap(o_file *of, int pages)
-{
-	void *addr;
-	size_t new_size = pages * of->pagsize;
-	size_t old_size = of->mapped.pages * of->pagsize;
-
-#ifdef linux
-	addr = mremap(of->mapped.base, old_size, new_size, MREMAP_MAYMOVE);
-	assert(addr != (void *)-1);
-#else
-#warning "There isn't mremap, using mmap in a ugly implementation"
-	/* Este es un reemplazo de mremap temporal, no me gusta */
-	munmap(of->mapped.base, old_size);
-	addr = mmap(of->mapped.base, new_size, of->mapped.prot, MAP_SHARED, of->fd, 0); /* MAP_FIXED no es necesario */
-	assert(addr != (void *)-1);
-#endif
+	if(of->win.max) {
+		o_win_put(of, e->head);
+		if(!(e->head = o_win_get(of, offset, mdsize + namesize)))
+			return 0;
+	}
+	e->name = e->head + mdsize;
+	e->data = e->name + namesize;
 
-	if(addr != of->mapped.base) {
-		of->mapped.base = addr;
-		o_update_offset(of, 0, 0);
+	/* El nombre termina donde dice la metadata */
+	if(e->name[namesize - 1] != '\0') {
+		o_entry_put(of, e);
+		return 0;
 	}
 
-	of->mapped.pages = pages;
+	return 1;
 }
 
-int o_close(o_file *of)
+/* o_entry_at(): Como o_entry_head(), con los datos tambien */
+static int o_entry_at(o_file *of, off_t offset, o_entry_view *e)
 {
-	close(of->fd);
-	ocore_hash_free_table(&of->hash);
-	munmap(of->mapped.base, OFILE_PAGES(of) * of->pagsize);
-	free(of);
+	size_t limit = of->win.max? of->win.fsize : OMAPPED(of), head;
+
+	if(!o_entry_head(of, offset, e))
+		return 0;
+
+	head = e->data - e->head;
+	if(e->md.size > limit - offset - head || O_CODEC(&e->md) > O_CODEC_LZ_DICT) {
+		o_entry_put(of, e);
+		return 0;
+	}
+	if(of->win.max) {
+		o_win_put(of, e->head);
+		if(!(e->head = o_win_get(of, offset, head + e->md.size)))
+			return 0;
+		e->name = e->head + O_MDSIZE(of);
+		e->data = e->head + head;
+	}
 
 	return 1;
 }
 
-/* o_write(): Escribe al final del fichero la nueva entrada
- */
-static int o_write(o_file *of, const char *name, void *data, o_metadata *md)
+/* o_name_eq(): El nombre de la entrada en 'offset' es 'name' */
+static int o_name_eq(o_file *of, off_t offset, const char *name, unsigned int len)
 {
-	o_file_header *header;
-	void *dst;
-	int pages, old_sz;
-
-	old_sz = OFILE_SIZE(of);
+	o_entry_view e;
+	int eq;
 
-	if(ftruncate(of->fd, old_sz + sizeof(o_metadata) + O_NAMESIZE(md) + md->size) == -1) {
-		perror("ftruncate");
+	if(!o_entry_head(of, offset, &e))
 		return 0;
-	}
+	eq = O_NAMELEN(&e.md) == len && strncasecmp(name, e.name, len + 1) == 0;
+	o_entry_put(of, &e);
 
-	header = of->mapped.base;
-	header->num++;
-	header->f_size += sizeof(o_metadata) + O_NAMESIZE(md) + md->size;
-	pages = OFILE_PAGES(of);
-	o_mremap(of, pages);
+	return eq;
+}
 
-	dst = OADDR(of, old_sz);
-	memcpy(dst, md, sizeof(o_metadata));
-	dst = (caddr_t)dst + sizeof(o_metadata); 
-	memcpy(dst, name, O_NAMESIZE(md));
-	dst = (caddr_t)dst + O_NAMESIZE(md);
-	memcpy(dst, data, md->size);
+static int o_md_dead(o_file *of, off_t offset)
+{
+	o_entry_view e;
+
+	if(!o_entry_head(of, offset, &e))
+		return 1;
+	o_entry_put(of, &e);
 
-	return old_sz;
+	return O_ISDEAD(&e.md) != 0;
 }
 
-/* o_write_entry(): Verifica la existencia de una entrada con el mismo nombre, agrega
- * la nueva entrada en la tabla hash y finalmente llama a o_write().
+/* o_index_probe(), o_index_find(): Retorna el slot de la entrada 'name' o -1.
+ * Solo se leen los nombres de los slots con el mismo hash y largo.
  */
-int o_write_entry(o_file *of, const char *name, void *data, size_t size)
+static long o_index_probe(o_file *of, o_index_slot *slots, unsigned int size,
+	const char *name, unsigned int h)
 {
-	ocore_hash_node *node;
-	o_metadata md;
+	unsigned int mask = size - 1, i, n;
+	unsigned int len = strlen(name);
 	off_t offset;
 
-	if(size == 0)
-		return 0;
-
-	if( !(node = ocore_hash_add(&of->hash, name, NULL, 0)) )
-		return 0;
+	/* En modo compartido un lector puede ver el indice a medio cambiar,
+	 * nada se lee fuera de la memoria mapeada (o_read_retry() repite).
+	 */
+	if(!of->priv.slots && (caddr_t)(slots + size) > OADDR(of, OMAPPED(of)))
+		return -1;
+
+	for(i = h & mask, n = 0; n < size && slots[i].offset != O_INDEX_EMPTY; i = (i + 1) & mask, n++) {
+		offset = slots[i].offset;
+		if(slots[i].hash == h && slots[i].namelen == len && offset != O_INDEX_DELETED &&
+		   o_name_eq(of, offset, name, len))
+			return i;
+	}
 
-	md.namelen = strlen(name);
-	md.size = size;
+	return -1;
+}
 
-	if( !(offset = o_write(of, name, data, &md)) ) {
-		ocore_hash_remove(&of->hash, name);
-		return 0;
+/* o_win_probe(): o_index_probe() con ventanas, sobre el indice del fichero.
+ * Los slots se leen de a uno con win.mutex tomado una vez, se suelta solo
+ * para comparar un nombre. Retorna el offset de la entrada o 0.
+ */
+static off_t o_win_probe(o_file *of, const char *name, unsigned int h)
+{
+	off_t base = OHEADER(of)->index, pos;
+	unsigned int size = OHEADER(of)->index_size, mask = size - 1, i, n;
+	unsigned int len = strlen(name);
+	o_index_slot slot;
+	o_window *w;
+
+	base = (base + O_DEAD_MIN + O_INDEX_ALIGN - 1) & ~(off_t)(O_INDEX_ALIGN - 1);
+	pthread_mutex_lock(&of->win.mutex);
+	for(i = h & mask, n = 0; n < size; i = (i + 1) & mask, n++) {
+		pos = base + (off_t)i * sizeof(o_index_slot);
+		if(!(w = o_win_find(of, pos, sizeof(o_index_slot))))
+			break;
+		memcpy(&slot, (caddr_t)w->addr + (pos - w->start), sizeof(o_index_slot));
+
+		if(slot.offset == O_INDEX_EMPTY)
+			break;
+		if(slot.hash == h && slot.namelen == len && slot.offset != O_INDEX_DELETED) {
+			pthread_mutex_unlock(&of->win.mutex);
+			if(o_name_eq(of, slot.offset, name, len))
+				return slot.offset;
+			pthread_mutex_lock(&of->win.mutex);
+		}
 	}
+	pthread_mutex_unlock(&of->win.mutex);
 
-	node->value = (void *)offset;
-	node->name = (char *)OADDR(of, offset + sizeof(o_metadata));
+	return 0;
+}
 
-	return size;
+static long o_index_find(o_file *of, const char *name, unsigned int h)
+{
+	return o_index_probe(of, o_index(of), o_index_size(of), name, h);
 }
 
-/* o_read(): Copia 'len' bytes en la direccion 'buf' de la entrada
+/* o_index_slot_of(): Slot de la entrada en 'offset', que debe estar en el indice
  */
-static int o_read(o_file *of, off_t offset, void *buf, size_t len)
+static unsigned int o_index_slot_of(o_file *of, unsigned int h, off_t offset)
 {
-	void *src;
-	o_metadata *md;
+	o_index_slot *slots = o_index(of);
+	unsigned int mask = o_index_size(of) - 1, i;
 
-	if(len <= 0)
-		return 0;
+	for(i = h & mask; slots[i].offset != offset; i = (i + 1) & mask)
+		assert(slots[i].offset != O_INDEX_EMPTY);
 
-	md = (o_metadata *)OADDR(of, offset);
+	return i;
+}
 
-	if(md->size > len)
-		len = md->size;
+/* o_index_put(): Copia 'key' en el primer slot libre o borrado.
+ * Retorna 1 si ocupo un slot que estaba vacio.
+ */
+static int o_index_put(o_index_slot *slots, unsigned int size, const o_index_slot *key)
+{
+	unsigned int mask = size - 1, i;
+	int empty;
 
-	src = OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(md));
+	for(i = key->hash & mask; slots[i].offset > O_INDEX_DELETED; i = (i + 1) & mask)
+		;
 
-	memcpy(buf, src, len);
+	empty = slots[i].offset == O_INDEX_EMPTY;
+	slots[i] = *key;
 
-	return len;
+	return empty;
 }
 
-/* o_read_entry(): Busca la entrada en la tabla hash y llama a o_read().
- */
-int o_read_entry(o_file *of, const char *name, void *buf, size_t len) 
+static void o_index_add(o_file *of, unsigned int h, size_t namelen, off_t offset)
 {
-	off_t offset;
+	o_index_slot key;
 
-	offset = (off_t)ocore_hash_get_value(&of->hash, name);
-	if(!offset)
-		return 0;
-
-	return o_read(of, offset, buf, len);
+	key.hash = h;
+	key.namelen = namelen;
+	key.offset = offset;
+	OHEADER(of)->index_used += o_index_put(o_index(of), OHEADER(of)->index_size, &key);
 }
 
-static void o_delete(o_file *of, off_t offset)
+/* o_index_drop(): Libera el slot 'i'. Si el siguiente esta vacio ninguna
+ * busqueda pasa por el, y tambien queda vacio.
+ */
+static void o_index_drop(o_file *of, unsigned int i)
 {
-	o_file_header *header;
-	o_metadata md;
-	int bytes, count, pages;
-	int8_t *src,*dst;
+	o_index_slot *slots = o_index(of);
+	unsigned int mask = OHEADER(of)->index_size - 1;
 
-	/* 	     E	    M	   M			   	 
-	   |------|------|------|------|	|------|------|------|
-	   |  1   |  2o<----3o<----4o  | ---->  |  1   |  3   |	 4   |
-	   |------|------|------|------|	|------|------|------|
-				esa es la idea...
-	*/
+	if(slots[(i + 1) & mask].offset == O_INDEX_EMPTY) {
+		slots[i].offset = O_INDEX_EMPTY;
+		OHEADER(of)->index_used--;
+	} else
+		slots[i].offset = O_INDEX_DELETED;
+}
 
-	memcpy(&md, OADDR(of, offset), sizeof(o_metadata));
+/* o_index_resize(): Traslada el indice a una nueva entrada de 'size' slots,
+ * sin los slots borrados. La entrada vieja queda eliminada.
+ */
+static int o_index_resize(o_file *of, unsigned int size)
+{
+	o_index_slot *slots, *old;
+	unsigned int i, used = 0;
+	off_t offset, prev;
+	o_metadata md;
 
-	/* Bytes a mover */
-	bytes = OFILE_SIZE(of) - (offset + O_SZINFILE(&md));
-	count = 0;
+	md.namelen = O_MD_SYS;
+	md.size = size * sizeof(o_index_slot) + O_INDEX_ALIGN - 1;
+	md.crc = md.reserved = 0;
 
-	dst = (int8_t *)OADDR(of, offset);
-	src = (int8_t *)OADDR(of, offset + O_SZINFILE(&md));
+	if(!(offset = o_reserve(of, "", &md)))
+		return 0;
 
-	/* Relocalizacion de los octectos */
-	for(count = 0; count < bytes; count++)
-		dst[count] = src[count];
+	slots = O_INDEX_AT(of, offset);
+	memset(slots, 0, size * sizeof(o_index_slot));
 
-	header = of->mapped.base;
-	header->num -= 1; /* Numero de elementos disminuye en 1 */
-	header->f_size = offset + count; /* "offset + count" es el ultimo byte escrito, por lo tanto es el nuevo tamano */
+	if( (prev = OHEADER(of)->index) ) {
+		old = O_INDEX_AT(of, prev);
+		for(i = 0; i < OHEADER(of)->index_size; i++)
+			if(old[i].offset > O_INDEX_DELETED)
+				used += o_index_put(slots, size, &old[i]);
+		o_delete(of, prev);
+	}
 
-	ftruncate(of->fd, OFILE_SIZE(of));
-	o_update_offset(of, offset, O_SZINFILE(&md));
+	OHEADER(of)->index = offset;
+	OHEADER(of)->index_size = size;
+	OHEADER(of)->index_used = used;
 
-	pages = OFILE_PAGES(of);
-	o_mremap(of, pages);
+	return 1;
 }
 
-int o_delete_entry(o_file *of, const char *name)
+/* o_index_reserve(): Asegura lugar en el indice para 'n' entradas nuevas
+ */
+static int o_index_reserve(o_file *of, unsigned int n)
 {
-	off_t offset;
+	o_file_header *header = OHEADER(of);
+	unsigned int size = OFILE_HASHSIZE;
 
-	if(!(of->flags & O_RDWR))
-		return 0;
+	if((header->index_used + n) * OFILE_INDEX_LOAD <= header->index_size)
+		return 1;
 
-	offset = (off_t)ocore_hash_get_value(&of->hash, name);
-	if(!offset)
-		return 0;
+	/* Queda a lo mas a la mitad de la carga maxima */
+	while(size < (header->num + n) * OFILE_INDEX_LOAD * 2)
+		size *= 2;
 
-	ocore_hash_remove(&of->hash, name);
-	o_delete(of, offset);
-	return 1;
+	return o_index_resize(of, size);
 }
 
-int o_rename_entry(o_file *of, const char *old, const char *new)
+/* o_lookup(): Retorna el offset de la entrada 'name', 0 si no existe
+ */
+static off_t o_lookup(o_file *of, const char *name)
 {
-	void *data, *dst;
-	ocore_hash_node *node;
-	size_t end, entry_size;
-	o_metadata md, *md_p;
+	o_index_slot *slots;
+	long i;
 
-	if(!(of->flags & O_RDWR))
-		return 0;
+	if(of->win.max && !of->priv.slots)
+		return o_win_probe(of, name, o_hash(name));
 
-	node = ocore_hash_change_key(&of->hash, old, new);
-	if(!node)
+	/* Se usa el mismo indice de la busqueda, un escritor puede moverlo */
+	slots = o_index(of);
+	i = o_index_probe(of, slots, o_index_size(of), name, o_hash(name));
+	if(i < 0)
 		return 0;
 
-	md_p = (o_metadata *)OADDR(of, (off_t)node->value);
-	md.namelen = strlen(new);
-	md.size = md_p->size;
+	/* El indice propio no se entera de las eliminaciones */
+	if(of->priv.slots && o_md_dead(of, slots[i].offset))
+		return 0;
 
-	/* Cuando los nombres son del mismo tamao,
-	 * solo escribo el nuevo sobre el viejo.
-	 */
-	if(md.namelen == md_p->namelen) {
-		/* Escribo el nuevo nombre */
-		dst = OADDR(of, (off_t)node->value + sizeof(o_metadata));
-		memcpy(dst, new, md.namelen);
-		/* Asigno el nombre final */
-		node->name = dst;
+	return slots[i].offset;
+}
 
-		return 1;
-	}
+/* o_order_add(), o_order_del(): Mantienen los nombres en orden, si ya se
+ * armaron. Se llaman dentro de la modificacion.
+ */
+static void o_order_add(o_file *of, const char *name)
+{
+	if(of->order.valid)
+		ocore_skiplist_add(&of->order.names, name, NULL);
+}
 
-	/* Salvo el tamao del fichero (final), para luego saber donde esta la nueva entrada */
-	end = OFILE_SIZE(of);
+static void o_order_del(o_file *of, const char *name)
+{
+	if(of->order.valid)
+		ocore_skiplist_remove(&of->order.names, name);
+}
 
-	/* Lo siguiente es escribir la informacion otra vez pero con el nuevo
- 	 * nombre y finalmente eliminar la vieja entrada. De esta forma me aseguro de no perder
-	 * informacion. La forma errada es rescatar, eliminar, escribir.
-	 */
+/* o_map_update(): En modo compartido otro proceso puede agrandar el
+ * fichero, la memoria mapeada se pone al dia con el espacio reservado.
+ */
+static void o_map_update(o_file *of)
+{
+	size_t cap;
 
-	data = o_access_to_mem(of, (off_t)node->value, NULL);
+	if(of->win.max)
+		return;
 
-	if(o_write(of, new, data, &md) < md.size)
-		return 0; /* No fue posible cambiar de nombre, se mantiene el viejo */
+	pthread_rwlock_rdlock(&of->mapped.lock);
+	cap = OFILE_CAPACITY(of);
+	pthread_rwlock_unlock(&of->mapped.lock);
+	if(cap > OMAPPED(of))
+		o_mremap(of, PAGES(of->pagsize, cap));
+}
 
-	entry_size = O_SZINFILE(md_p);
+/* o_begin(), o_end(): Delimitan una modificacion del fichero. Si el proceso
+ * termina entre ambas, el siguiente escritor (o o_open()) reconstruye el
+ * indice. La generacion es impar durante la modificacion, y en modo
+ * compartido el escritor tiene el flock() exclusivo.
+ */
+static void o_begin(o_file *of)
+{
+	o_file_header *header;
 
-	/* Ultimo argumento 0, para que no libere el nodo que utiliza en la hash table */
-	o_delete(of, (off_t)node->value);
+	pthread_mutex_lock(&of->lock);
+	if(of->opts & O_OPT_SHARED) {
+		flock(of->fd, LOCK_EX);
+		o_map_update(of);
+	}
 
-	node->value = (void *)(end - entry_size);
-	node->name = (char *)( OADDR(of, (off_t)node->value + sizeof(o_metadata)) );
+	header = OHEADER(of);
+	/* Generacion impar sin nadie modificando: el escritor anterior murio */
+	if(header->gen & 1)
+		header->gen++;
+	/* Otro proceso modifico el fichero, los nombres en orden ya no sirven */
+	if(header->gen != of->order.gen)
+		of->order.valid = 0;
+	if((of->opts & O_OPT_SHARED) && header->gen != of->verify.gen)
+		o_verified_reset(of);
+	header->lock = getpid();
+	header->gen++;
+	__sync_synchronize();
+
+	if(OHEADER(of)->dirty || OHEADER(of)->index == 0) {
+		OHEADER(of)->dirty = 1;
+		o_index_rebuild(of);
+	}
+	OHEADER(of)->dirty = 1;
+}
 
-	return 1;
+static void o_end(o_file *of)
+{
+	o_file_header *header = OHEADER(of);
+
+	header->dirty = 0;
+	__sync_synchronize();
+	header->gen++;
+	header->lock = 0;
+	if(of->order.valid)
+		of->order.gen = header->gen;
+	of->verify.gen = header->gen;
+	o_mlock_update(of);
+
+	if(of->opts & O_OPT_SHARED)
+		flock(of->fd, LOCK_UN);
+
+	o_commit_done(of);
+	pthread_mutex_unlock(&of->lock);
 }
 
-off_t o_get_offset(o_file *of, const char *name)
+/* o_writer_dead(): El escritor tiene el lock mientras modifica. Si se puede
+ * tomar y la generacion sigue impar, murio a medio modificar.
+ */
+static int o_writer_dead(o_file *of)
 {
-	return (off_t)ocore_hash_get_value(&of->hash, name);
+	int dead;
+
+	if(flock(of->fd, LOCK_SH|LOCK_NB) == -1)
+		return 0;
+
+	pthread_rwlock_rdlock(&of->mapped.lock);
+	dead = *(volatile unsigned int *)&OHEADER(of)->gen & 1;
+	pthread_rwlock_unlock(&of->mapped.lock);
+	flock(of->fd, LOCK_UN);
+
+	return dead;
 }
 
-void *o_access_to_mem(o_file *of, off_t offset, size_t *size)
+/* o_read_begin(), o_read_retry(): Lectura con seqlock en modo compartido.
+ * o_read_begin() espera que no haya una modificacion en curso y pone al dia
+ * la memoria mapeada. Retorna la generacion, o -1 si el ultimo escritor
+ * murio a medio modificar. Si o_read_retry() retorna 1, la lectura se cruzo
+ * con un escritor y hay que repetirla. Entre ambas la memoria mapeada no
+ * cambia de direccion (ver o_mremap()); o_read_end() termina sin revisar.
+ */
+static long o_read_begin(o_file *of)
 {
-	o_metadata *md;
+	unsigned int gen;
+	int n = 0;
 
-	if(offset < O_HEADERSIZE || offset > OFILE_SIZE(of))
-		return NULL;
+	if(!(of->opts & O_OPT_SHARED))
+		return 0;
 
-	md = (o_metadata *)( OADDR(of, offset) );
-	if(size)
-		*size = md->size;
+	pthread_rwlock_rdlock(&of->mapped.lock);
+	while( (gen = *(volatile unsigned int *)&OHEADER(of)->gen) & 1 ) {
+		pthread_rwlock_unlock(&of->mapped.lock);
+		if(++n % O_SPIN_CHECK == 0 && o_writer_dead(of))
+			return -1;
+		sched_yield();
+		pthread_rwlock_rdlock(&of->mapped.lock);
+	}
+	__sync_synchronize();
+
+	/* Agrandar la memoria mapeada o soltar el indice propio cambia lo que
+	 * usan los otros hilos: se hace sin lectores.
+	 */
+	if(OFILE_CAPACITY(of) > OMAPPED(of) ||
+	   (of->priv.slots && OHEADER(of)->index && !OHEADER(of)->dirty)) {
+		pthread_rwlock_unlock(&of->mapped.lock);
+		o_map_update(of);
+
+		/* El indice propio solo se usa hasta que un escritor repare el del fichero */
+		pthread_rwlock_wrlock(&of->mapped.lock);
+		if(of->priv.slots && OHEADER(of)->index && !OHEADER(of)->dirty) {
+			free(of->priv.slots);
+			of->priv.slots = NULL;
+		}
+		pthread_rwlock_unlock(&of->mapped.lock);
+		pthread_rwlock_rdlock(&of->mapped.lock);
+	}
+
+	/* Otro proceso escribio, las entradas se revisan otra vez */
+	if(gen != of->verify.gen) {
+		o_verified_reset(of);
+		of->verify.gen = gen;
+	}
 
-	return (void *)( OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(md)) );
+	return gen;
 }
- 
-int o_touch_entry(o_file *of, const char *name)
+
+static int o_read_retry(o_file *of, long gen)
 {
-	off_t offset;
-	o_metadata *md;
+	int retry;
 
-	offset = (off_t)ocore_hash_get_value(&of->hash, name);
-	if(offset == 0)
+	if(!(of->opts & O_OPT_SHARED))
 		return 0;
 
-	md = (o_metadata *)OADDR(of, offset);
+	__sync_synchronize();
+	retry = *(volatile unsigned int *)&OHEADER(of)->gen != (unsigned int)gen;
+	pthread_rwlock_unlock(&of->mapped.lock);
 
-	return md->size;
+	return retry;
 }
 
-void o_clean_up(o_file *of)
+static void o_read_end(o_file *of)
 {
-	ocore_hash_position pst;
-	ocore_hash_node *node;
+	if(of->opts & O_OPT_SHARED)
+		pthread_rwlock_unlock(&of->mapped.lock);
+}
 
-	if(!(of->flags & O_RDWR))
-		return;
+#define O_VBITS	(sizeof(unsigned long) * 8)
 
-	if(of) {
-		pst.node = NULL;
-		pst.idx = 0;
+/* o_verified_test(), o_verified_set(), o_verified_clear(): Bits de las
+ * entradas con el CRC32C revisado (ver o_verified). Los lectores los
+ * marcan sin lock, los escritores los borran al escribir una entrada.
+ */
+static int o_verified_test(o_file *of, off_t offset)
+{
+	o_verified *v = __atomic_load_n(&of->verify.map, __ATOMIC_ACQUIRE);
+	size_t i = offset / O_VERIFY_GRAIN;
 
-		while( (node = ocore_hash_list(&of->hash, &pst)) ) {
-			o_delete(of, (off_t)node->value);
-		}
+	return v && i < v->bits && (__atomic_load_n(&v->map[i / O_VBITS], __ATOMIC_RELAXED) >> (i % O_VBITS)) & 1;
+}
 
-		ocore_hash_destroy_all(&of->hash);
+/* o_verified_map(): El mapa, con lugar para la entrada en 'offset' */
+static o_verified *o_verified_map(o_file *of, off_t offset)
+{
+	o_verified *v = __atomic_load_n(&of->verify.map, __ATOMIC_ACQUIRE), *n;
+	size_t i = offset / O_VERIFY_GRAIN, words;
+
+	if(!v || i >= v->bits) {
+		pthread_mutex_lock(&of->verify.mutex);
+		v = of->verify.map;
+		if(!v || i >= v->bits) {
+			words = (OFILE_CAPACITY(of) / O_VERIFY_GRAIN) / O_VBITS + 1;
+			if(v && words < v->bits / O_VBITS * 2)
+				words = v->bits / O_VBITS * 2;
+			if(words <= i / O_VBITS)
+				words = i / O_VBITS + 1;
+
+			if(!(n = calloc(1, sizeof(o_verified) + words * sizeof(unsigned long)))) {
+				perror("calloc");
+				exit(EXIT_FAILURE);
+			}
+			n->bits = words * O_VBITS;
+			if(v)
+				memcpy(n->map, v->map, v->bits / O_VBITS * sizeof(unsigned long));
+			n->old = v;
+			__atomic_store_n(&of->verify.map, n, __ATOMIC_RELEASE);
+			v = n;
+		}
+		pthread_mutex_unlock(&of->verify.mutex);
 	}
 
+	return v;
+}
+
+static void o_verified_set(o_file *of, off_t offset)
+{
+	o_verified *v = o_verified_map(of, offset);
+	size_t i = offset / O_VERIFY_GRAIN;
+
+	__sync_fetch_and_or(&v->map[i / O_VBITS], 1UL << (i % O_VBITS));
+}
+
+/* o_verified_clear(): Las entradas que comienzan en [offset, offset + len)
+ * se deben revisar otra vez.
+ */
+static void o_verified_clear(o_file *of, off_t offset, size_t len)
+{
+	o_verified *v = __atomic_load_n(&of->verify.map, __ATOMIC_ACQUIRE);
+	size_t i = offset / O_VERIFY_GRAIN, end = (offset + len - 1) / O_VERIFY_GRAIN + 1, w;
+	unsigned long mask;
+
+	if(!v)
+		return;
+	if(end > v->bits)
+		end = v->bits;
+
+	while(i < end) {
+		w = i / O_VBITS;
+		mask = ~0UL << (i % O_VBITS);
+		if(end < (w + 1) * O_VBITS)
+			mask &= ~(~0UL << (end % O_VBITS));
+		__sync_fetch_and_and(&v->map[w], ~mask);
+		i = (w + 1) * O_VBITS;
+	}
+}
+
+static void o_verified_reset(o_file *of)
+{
+	o_verified *v = of->verify.map;
+
+	if(v)
+		memset(v->map, 0, v->bits / O_VBITS * sizeof(unsigned long));
+}
+
+/* o_md_good(): Revisa el CRC32C de la entrada la primera vez que se lee,
+ * despues queda marcada y no se vuelve a calcular. 'e' debe venir de
+ * o_entry_at().
+ */
+static int o_md_good(o_file *of, off_t offset, const o_entry_view *e)
+{
+	/* El formato 1 no tiene CRC */
+	if(of->v1 || o_verified_test(of, offset))
+		return 1;
+
+	if(ocore_crc32c(0, e->data, e->md.size) != e->md.crc)
+		return 0;
+
+	o_verified_set(of, offset);
+	return 1;
+}
+
+/* o_index_rebuild(): Recorre todo el fichero y reconstruye el indice, el
+ * numero de entradas, los bytes eliminados y las listas de huecos.
+ */
+static void o_index_rebuild(o_file *of)
+{
+	o_file_header *header = OHEADER(of);
+	o_index_slot *found = NULL;
+	unsigned int n = 0, max = 0, size = OFILE_HASHSIZE, i;
+	off_t offset = O_HEADERSIZE;
+	size_t dead = 0, sz;
+	o_metadata *md;
+	char *name;
+
+	/* Una compactacion a medio camino deja el hueco [dst, src) como
+	 * entrada eliminada, el recorrido no necesita seguirla.
+	 */
+	memset(header->free, 0, sizeof(header->free));
+	header->compacting = 0;
+	header->epoch++;
+	of->order.valid = 0;
+
+	/* Las entradas eliminadas siguen en el fichero, se recorre hasta el final */
+        while ( OFILE_SIZE(of) > offset ) {
+
+		md = (o_metadata *)OADDR(of, offset);
+		name = (char *)OADDR(of, offset + sizeof(o_metadata));
+		sz = O_SZINFILE(md);
+
+		/* Un indice anterior tambien se descarta, el diccionario y el
+		 * espacio de los escritores por partes abiertos no
+		 */
+		if(O_ISSYS(md) && !O_ISDEAD(md) && (offset == header->dict || (O_NAMELEN(md) && header->streams))) {
+			/* Se conserva */
+		} else if(O_ISDEAD(md) || O_ISSYS(md)) {
+			dead += sz;
+			if(sz >= O_FREE_MIN)
+				o_free_add(of, offset, sz);
+			else
+				md->namelen = (md->namelen & ~(O_MD_FREE|O_MD_SYS)) | O_MD_DEAD;
+		} else {
+			if(n == max) {
+				max = max? max * 2 : OFILE_HASHSIZE;
+				if(!(found = realloc(found, max * sizeof(o_index_slot)))) {
+					perror("realloc");
+					exit(EXIT_FAILURE);
+				}
+			}
+			found[n].hash = o_hash(name);
+			found[n].namelen = O_NAMELEN(md);
+			found[n++].offset = offset;
+		}
+
+		offset += sz;
+	}
+
+	while(size < n * OFILE_INDEX_LOAD * 2)
+		size *= 2;
+
+	header->dead = dead;
+	header->num = 0;
+	header->index = 0;
+	header->index_size = 0;
+	header->index_used = 0;
+	if(!o_index_resize(of, size)) {
+		fprintf(stderr, "%s(): can't write the index\n", __FUNCTION__);
+		exit(EXIT_FAILURE);
+	}
+
+	for(i = 0; i < n; i++) {
+		name = (char *)OADDR(of, found[i].offset + sizeof(o_metadata));
+		if(o_index_find(of, name, found[i].hash) >= 0) {
+			fprintf(stderr, "%s():\"%s\" already exists\n", __FUNCTION__, name);
+			continue;
+		}
+		o_index_add(of, found[i].hash, found[i].namelen, found[i].offset);
+		OHEADER(of)->num++;
+	}
+	free(found);
+}
+
+/* o_priv_add(): Agrega 'key' al indice propio, que crece al doble cuando
+ * pasa de la carga maxima.
+ */
+static void o_priv_add(o_file *of, const o_index_slot *key)
+{
+	o_index_slot *old = of->priv.slots, *slots;
+	unsigned int i, size = of->priv.size;
+
+	if((of->priv.used + 1) * OFILE_INDEX_LOAD > size) {
+		if(!(slots = calloc(size * 2, sizeof(o_index_slot)))) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		for(i = 0; i < size; i++)
+			if(old[i].offset > O_INDEX_DELETED)
+				o_index_put(slots, size * 2, &old[i]);
+		free(old);
+		of->priv.slots = slots;
+		of->priv.size = size * 2;
+	}
+
+	of->priv.used += o_index_put(of->priv.slots, of->priv.size, key);
+}
+
+/* o_priv_entry(): Agrega al indice propio la entrada en 'offset'. Una
+ * entrada nueva con el nombre de una eliminada (actualizada o renombrada)
+ * toma su slot.
+ */
+static void o_priv_entry(o_file *of, off_t offset, const o_entry_view *e)
+{
+	const char *name = e->name;
+	o_index_slot key;
+	long i;
+
+	if(O_ISDEAD(&e->md) || O_ISSYS(&e->md))
+		return;
+
+	key.hash = o_hash(name);
+	key.namelen = O_NAMELEN(&e->md);
+	key.offset = offset;
+
+	if((i = o_index_find(of, name, key.hash)) < 0)
+		o_priv_add(of, &key);
+	else if(of->priv.slots[i].offset == offset)
+		return;
+	else if(o_md_dead(of, of->priv.slots[i].offset))
+		of->priv.slots[i].offset = offset;
+	else
+		fprintf(stderr, "%s():\"%s\" already exists\n", __FUNCTION__, name);
+}
+
+/* o_priv_scan(): Agrega al indice propio las entradas escritas despues de
+ * la ultima revision, [of->priv.indexed, f_size).
+ */
+static void o_priv_scan(o_file *of)
+{
+	off_t offset = of->priv.indexed;
+	o_entry_view e;
+	size_t sz, limit;
+
+	/* Con ventanas el limite es el fichero, no la memoria mapeada */
+	limit = of->win.max? of->win.fsize : OMAPPED(of);
+	while(offset < OFILE_SIZE(of) && o_entry_head(of, offset, &e)) {
+		sz = o_entry_len(&e);
+		if(e.md.size > limit || sz > limit - offset) {
+			o_entry_put(of, &e);
+			break;
+		}
+
+		o_priv_entry(of, offset, &e);
+		o_entry_put(of, &e);
+
+		offset += sz;
+	}
+
+	of->priv.indexed = offset;
+}
+
+/* o_priv_reuse(): Agrega al indice propio las entradas escritas antes de
+ * of->priv.indexed desde la ultima revision (ver O_REUSE_LOG). Las de mas
+ * adelante las agrega o_priv_scan().
+ */
+static void o_priv_reuse(o_file *of)
+{
+	unsigned int reused = OHEADER(of)->reused;
+	o_entry_view e;
+	off_t offset;
+
+	for(; of->priv.reused != reused; of->priv.reused++) {
+		offset = OHEADER(of)->reuse[of->priv.reused % O_REUSE_LOG];
+		if(offset >= of->priv.indexed || !o_entry_head(of, offset, &e))
+			continue;
+		o_priv_entry(of, offset, &e);
+		o_entry_put(of, &e);
+	}
+}
+
+/* o_priv_build(): Indice en memoria propia para un lector, cuando el del
+ * fichero falta o no sirve. El fichero no se toca.
+ */
+static void o_priv_build(o_file *of)
+{
+	free(of->priv.slots);
+	if(!(of->priv.slots = calloc(OFILE_HASHSIZE, sizeof(o_index_slot)))) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	of->priv.size = OFILE_HASHSIZE;
+	of->priv.used = 0;
+	of->priv.indexed = O_FIRST(of);
+	of->priv.epoch = OHEADER(of)->epoch;
+	of->priv.reused = OHEADER(of)->reused;
+
+	o_priv_scan(of);
+}
+
+/* o_mremap(): Cambia el tamano de la memoria mapeada, que puede cambiar de
+ * direccion. Los lectores de otros hilos la usan con of->mapped.lock
+ * tomado para lectura (o_read_begin()), aqui se toma para escritura. En
+ * modo compartido nunca se achica: varios hilos pueden ponerla al dia a la
+ * vez, y uno atrasado no deshace lo que agrando otro.
+ */
+static void o_mremap(o_file *of, size_t pages)
+{
+	void *addr;
+	size_t new_size, old_size;
+
+	pthread_rwlock_wrlock(&of->mapped.lock);
+	if((of->opts & O_OPT_SHARED) && pages <= of->mapped.pages) {
+		pthread_rwlock_unlock(&of->mapped.lock);
+		return;
+	}
+	new_size = pages * of->pagsize;
+	old_size = of->mapped.pages * of->pagsize;
+
+#ifdef linux
+	addr = mremap(of->mapped.base, old_size, new_size, MREMAP_MAYMOVE);
+	assert(addr != (void *)-1);
+#else
+#warning "There isn't mremap, using mmap in a ugly implementation"
+	/* Este es un reemplazo de mremap temporal, no me gusta */
+	munmap(of->mapped.base, old_size);
+	addr = mmap(of->mapped.base, new_size, of->mapped.prot, MAP_SHARED, of->fd, 0); /* MAP_FIXED no es necesario */
+	assert(addr != (void *)-1);
+#endif
+
+	of->mapped.base = addr;
+
+	of->mapped.pages = pages;
+	o_map_advise(of, old_size);
+	pthread_rwlock_unlock(&of->mapped.lock);
+}
+
+/* o_advice(): Patron de acceso de o_open() para madvise() */
+static int o_advice(o_file *of)
+{
+	if(of->opts & O_OPT_RANDOM)
+		return MADV_RANDOM;
+	if(of->opts & O_OPT_SEQUENTIAL)
+		return MADV_SEQUENTIAL;
+
+	return MADV_NORMAL;
+}
+
+/* o_map_advise(): Aplica las opciones de o_open() a la memoria mapeada desde
+ * 'from', lo que se acaba de mapear. Al abrir, MAP_POPULATE ya cargo todo.
+ */
+static void o_map_advise(o_file *of, size_t from)
+{
+	caddr_t addr = OADDR(of, from);
+	size_t len;
+
+	if(from >= OMAPPED(of))
+		return;
+	len = OMAPPED(of) - from;
+
+#ifdef MADV_HUGEPAGE
+	if(of->opts & O_OPT_HUGEPAGE)
+		madvise(addr, len, MADV_HUGEPAGE);
+#endif
+	if(o_advice(of) != MADV_NORMAL)
+		madvise(addr, len, o_advice(of));
+
+	if(from && (of->opts & O_OPT_POPULATE)) {
+#ifdef MADV_POPULATE_READ
+		if(madvise(addr, len, MADV_POPULATE_READ) == 0)
+			return;
+#endif
+		madvise(addr, len, MADV_WILLNEED);
+	}
+}
+
+/* o_mlock_update(): Con OF_MLOCK la cabecera y el indice quedan en memoria.
+ * Se llama cuando el indice puede haber cambiado de lugar o de tamano. Las
+ * paginas siguen bloqueadas si mremap() mueve la memoria mapeada, por eso
+ * se recuerda el offset y no la direccion.
+ */
+static void o_mlock_update(o_file *of)
+{
+	off_t index = OHEADER(of)->index, start = 0;
+	size_t len = 0;
+
+	if(!(of->opts & O_OPT_MLOCK))
+		return;
+
+	if(index && index + sizeof(o_metadata) <= OMAPPED(of)) {
+		start = index - index % of->pagsize;
+		len = index + O_SZINFILE((o_metadata *)OADDR(of, index)) - start;
+		if(start + len > OMAPPED(of))
+			len = OMAPPED(of) - start;
+	}
+	if(of->mlocked.len && start == of->mlocked.offset && len == of->mlocked.len)
+		return;
+
+	/* munlock() puede incluir la pagina de la cabecera */
+	if(of->mlocked.len)
+		munlock(OADDR(of, of->mlocked.offset), of->mlocked.len);
+	if(mlock(of->mapped.base, O_HEADERSIZE) == -1 || (len && mlock(OADDR(of, start), len) == -1)) {
+		perror("mlock");
+		of->opts &= ~O_OPT_MLOCK;
+		len = 0;
+	}
+	of->mlocked.offset = start;
+	of->mlocked.len = len;
+}
+
+/* o_win_find(): Con ventanas (OF_WINDOW), la ventana que contiene
+ * [offset, offset + len) del fichero. Si no hay, mapea una de OFILE_WINDOW
+ * bytes (mas, si la entrada no cabe) en lugar de la menos usada. Se llama
+ * con win.mutex tomado. Retorna NULL si todas estan fijadas.
+ */
+static o_window *o_win_find(o_file *of, off_t offset, size_t len)
+{
+	o_window *w = NULL, *lru = NULL;
+	size_t size, end;
+	off_t start;
+	void *addr;
+	int i;
+
+	for(i = 0; i < of->win.n; i++) {
+		w = &of->win.w[i];
+		if(offset >= w->start && offset + len <= w->start + w->len)
+			goto found;
+		if(w->pins == 0 && (!lru || w->used < lru->used))
+			lru = w;
+	}
+
+	start = offset - offset % OFILE_WINDOW;
+	end = PAGES(of->pagsize, of->win.fsize) * (size_t)of->pagsize;
+	size = offset + len - start;
+	size = size < OFILE_WINDOW? OFILE_WINDOW : PAGES(of->pagsize, size) * (size_t)of->pagsize;
+	if(start + size > end && offset + len <= end)
+		size = end - start;
+
+	if(of->win.n < of->win.max)
+		w = &of->win.w[of->win.n++];
+	else if((w = lru))
+		munmap(w->addr, w->len);
+	else {
+		fprintf(stderr, "%s(): every window is in use\n", __FUNCTION__);
+		return NULL;
+	}
+
+	addr = mmap(0, size, PROT_READ, MAP_SHARED, of->fd, start);
+	if(addr == MAP_FAILED) {
+		perror("mmap");
+		*w = of->win.w[--of->win.n];
+		return NULL;
+	}
+	w->addr = addr;
+	w->start = start;
+	w->len = size;
+	w->pins = 0;
+#ifdef MADV_HUGEPAGE
+	if(of->opts & O_OPT_HUGEPAGE)
+		madvise(addr, size, MADV_HUGEPAGE);
+#endif
+	if(o_advice(of) != MADV_NORMAL)
+		madvise(addr, size, o_advice(of));
+
+found:
+	w->used = ++of->win.clock;
+	return w;
+}
+
+/* o_win_get(): Direccion de [offset, offset + len) del fichero en su
+ * ventana, que queda fijada hasta o_win_put(). Retorna NULL si todas estan
+ * fijadas.
+ */
+static void *o_win_get(o_file *of, off_t offset, size_t len)
+{
+	o_window *w;
+
+	pthread_mutex_lock(&of->win.mutex);
+	if((w = o_win_find(of, offset, len)))
+		w->pins++;
+	pthread_mutex_unlock(&of->win.mutex);
+
+	return w? (caddr_t)w->addr + (offset - w->start) : NULL;
+}
+
+/* o_win_put(): Suelta la ventana que contiene 'addr' */
+static void o_win_put(o_file *of, const void *addr)
+{
+	o_window *w;
+	int i;
+
+	pthread_mutex_lock(&of->win.mutex);
+	for(i = 0; i < of->win.n; i++) {
+		w = &of->win.w[i];
+		if((caddr_t)addr >= (caddr_t)w->addr && (caddr_t)addr < (caddr_t)w->addr + w->len) {
+			if(w->pins > 0)
+				w->pins--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&of->win.mutex);
+}
+
+/* o_commit_done(): Cuenta una modificacion terminada. En modo 'd' se lleva a
+ * disco de inmediato.
+ */
+static void o_commit_done(o_file *of)
+{
+	unsigned long seq = __sync_add_and_fetch(&of->commit.seq, 1);
+
+	if(of->opts & O_OPT_SYNC) {
+		fdatasync(of->fd);
+		pthread_mutex_lock(&of->commit.mutex);
+		if(of->commit.synced < seq)
+			of->commit.synced = seq;
+		pthread_mutex_unlock(&of->commit.mutex);
+	}
+}
+
+/* o_commit_flush(): Lleva a disco todas las modificaciones terminadas hasta
+ * ahora. fdatasync() incluye las paginas mapeadas, un solo llamado cubre
+ * todas las escrituras del grupo. Se llama con commit.mutex tomado.
+ */
+static void o_commit_flush(o_file *of)
+{
+	unsigned long seq = o_commit_ticket(of);
+
+	if(of->commit.synced >= seq)
+		return;
+
+	pthread_mutex_unlock(&of->commit.mutex);
+	fdatasync(of->fd);
+	pthread_mutex_lock(&of->commit.mutex);
+
+	if(of->commit.synced < seq)
+		of->commit.synced = seq;
+	pthread_cond_broadcast(&of->commit.done);
+}
+
+/* o_commit_thread(): Commit en grupo. Cada OFILE_COMMIT_USEC, o antes si
+ * alguien espera un ticket, lleva a disco lo escrito desde la vez anterior.
+ */
+static void *o_commit_thread(void *arg)
+{
+	o_file *of = arg;
+	struct timespec ts;
+	struct timeval now;
+
+	pthread_mutex_lock(&of->commit.mutex);
+	while(of->commit.running) {
+		gettimeofday(&now, NULL);
+		ts.tv_sec = now.tv_sec + (now.tv_usec + OFILE_COMMIT_USEC) / 1000000;
+		ts.tv_nsec = ((now.tv_usec + OFILE_COMMIT_USEC) % 1000000) * 1000;
+		pthread_cond_timedwait(&of->commit.kick, &of->commit.mutex, &ts);
+		o_commit_flush(of);
+	}
+	pthread_mutex_unlock(&of->commit.mutex);
+
+	return NULL;
+}
+
+/* o_commit_ticket(): Ticket de las modificaciones terminadas hasta ahora
+ */
+unsigned long o_commit_ticket(o_file *of)
+{
+	return __sync_add_and_fetch(&of->commit.seq, 0);
+}
+
+/* o_commit_wait(): Espera a que las modificaciones del ticket esten en
+ * disco. En commit en grupo despierta al hilo y espera su fdatasync(), si
+ * no, lo hace aqui mismo.
+ */
+void o_commit_wait(o_file *of, unsigned long ticket)
+{
+	pthread_mutex_lock(&of->commit.mutex);
+	while(of->commit.synced < ticket) {
+		if(of->commit.running) {
+			pthread_cond_signal(&of->commit.kick);
+			pthread_cond_wait(&of->commit.done, &of->commit.mutex);
+		} else
+			o_commit_flush(of);
+	}
+	pthread_mutex_unlock(&of->commit.mutex);
+}
+
+/* o_sync(): Lleva a disco todo lo escrito hasta ahora
+ */
+void o_sync(o_file *of)
+{
+	o_commit_wait(of, o_commit_ticket(of));
+}
+
+int o_close(o_file *of)
+{
+	o_verified *v;
+	int i;
+
+	if(of->commit.running) {
+		pthread_mutex_lock(&of->commit.mutex);
+		of->commit.running = 0;
+		pthread_cond_signal(&of->commit.kick);
+		pthread_mutex_unlock(&of->commit.mutex);
+		pthread_join(of->commit.thread, NULL);
+		/* Lo escrito antes de cerrar no queda sin llevar a disco */
+		o_sync(of);
+	}
+	pthread_mutex_destroy(&of->lock);
+	pthread_mutex_destroy(&of->commit.mutex);
+	pthread_mutex_destroy(&of->verify.mutex);
+	pthread_mutex_destroy(&of->aio.mutex);
+	pthread_mutex_destroy(&of->win.mutex);
+	pthread_mutex_destroy(&of->zdict.mutex);
+	pthread_rwlock_destroy(&of->mapped.lock);
+	for(i = 0; i < of->win.n; i++)
+		munmap(of->win.w[i].addr, of->win.w[i].len);
+	free(of->win.w);
+	if(of->aio.ring.fd >= 0)
+		ocore_uring_free(&of->aio.ring);
+	while(of->verify.map) {
+		v = of->verify.map->old;
+		free(of->verify.map);
+		of->verify.map = v;
+	}
+	pthread_cond_destroy(&of->commit.done);
+	pthread_cond_destroy(&of->commit.kick);
+
+	close(of->fd);
+	free(of->priv.slots);
+	free(of->v1);
+	free(of->zdict.data);
+	ocore_skiplist_free(&of->order.names);
+	munmap(of->mapped.base, of->mapped.pages * of->pagsize);
+	free(of);
+
+	return 1;
+}
+
+/* o_put_dead(): Escribe en 'offset' una entrada eliminada de 'size' bytes
+ * (al menos O_DEAD_MIN) que no esta en ninguna lista.
+ */
+static void o_put_dead(o_file *of, off_t offset, size_t size)
+{
+	o_metadata *md = (o_metadata *)OADDR(of, offset);
+
+	md->namelen = O_MD_DEAD;
+	md->size = size - O_DEAD_MIN;
+	*(char *)OADDR(of, offset + sizeof(o_metadata)) = 0;
+}
+
+static int o_free_class(size_t size)
+{
+	int c = 0;
+
+	for(size >>= 6; size && c < O_FREE_CLASSES - 1; size >>= 1)
+		c++;
+
+	return c;
+}
+
+/* o_free_add(): Convierte [offset, offset + size) en un hueco y lo enlaza
+ * al principio de la lista de su clase.
+ */
+static void o_free_add(o_file *of, off_t offset, size_t size)
+{
+	off_t *head = &OHEADER(of)->free[o_free_class(size)];
+	o_free_link *link;
+
+	o_put_dead(of, offset, size);
+	((o_metadata *)OADDR(of, offset))->namelen |= O_MD_FREE;
+
+	link = OFREE(of, offset);
+	link->prev = 0;
+	link->next = *head;
+	if(*head)
+		OFREE(of, *head)->prev = offset;
+	*head = offset;
+}
+
+/* o_free_unlink(): Saca un hueco de su lista, queda como entrada eliminada
+ */
+static void o_free_unlink(o_file *of, off_t offset)
+{
+	o_metadata *md = (o_metadata *)OADDR(of, offset);
+	o_free_link *link = OFREE(of, offset);
+
+	if(link->prev)
+		OFREE(of, link->prev)->next = link->next;
+	else
+		OHEADER(of)->free[o_free_class(O_SZINFILE(md))] = link->next;
+
+	if(link->next)
+		OFREE(of, link->next)->prev = link->prev;
+
+	md->namelen &= ~O_MD_FREE;
+}
+
+/* o_reused(): Anota una entrada escrita antes del final del fichero. Los
+ * lectores con indice propio la agregan sin reconstruirlo (o_priv_reuse()).
+ */
+static void o_reused(o_file *of, off_t offset)
+{
+	o_file_header *header = OHEADER(of);
+
+	header->reuse[header->reused++ % O_REUSE_LOG] = offset;
+}
+
+/* o_free_take(): Busca un hueco para 'need' bytes. Lo que sobra vuelve a
+ * las listas, o queda como entrada eliminada si es muy chico. Un hueco solo
+ * sirve si calza exacto o sobra espacio para una entrada eliminada.
+ */
+static off_t o_free_take(o_file *of, size_t need)
+{
+	off_t offset;
+	size_t size;
+	int c, n;
+
+	for(c = o_free_class(need); c < O_FREE_CLASSES; c++) {
+		offset = OHEADER(of)->free[c];
+		for(n = 0; offset && n < O_FREE_SCAN; n++) {
+			size = O_SZINFILE((o_metadata *)OADDR(of, offset));
+			if(size == need || size >= need + O_DEAD_MIN) {
+				o_free_unlink(of, offset);
+				if(size - need >= O_FREE_MIN)
+					o_free_add(of, offset + need, size - need);
+				else if(size > need)
+					o_put_dead(of, offset + need, size - need);
+
+				OHEADER(of)->dead -= need;
+				return offset;
+			}
+			offset = OFREE(of, offset)->next;
+		}
+	}
+
+	return 0;
+}
+
+/* o_grow(): Agranda el fichero y la memoria mapeada a lo menos hasta 'min'
+ * bytes. Crece en forma geometrica, asi la mayoria de las escrituras caben en
+ * el espacio ya reservado y no tocan ni el fichero ni el mapeo.
+ */
+static int o_grow(o_file *of, size_t min)
+{
+	size_t old = OFILE_CAPACITY(of), cap;
+	int err;
+
+	cap = old + old / OFILE_GROW_DIV;
+	if(cap < min)
+		cap = min;
+	cap = PAGES(of->pagsize, cap) * of->pagsize;
+
+	/* posix_fallocate() usa fallocate() si el sistema de ficheros lo
+	 * soporta. Solo si no hay como reservar se agranda con ftruncate(), sin
+	 * bloques; sin espacio (ENOSPC) la escritura falla aqui y no con un
+	 * SIGBUS al tocar la memoria mapeada.
+	 */
+	err = posix_fallocate(of->fd, old, cap - old);
+	/* Sin espacio para crecer en forma geometrica, lo justo */
+	if(err != 0 && err != EOPNOTSUPP && err != EINVAL && cap > PAGES(of->pagsize, min) * of->pagsize) {
+		ftruncate(of->fd, old);
+		cap = PAGES(of->pagsize, min) * of->pagsize;
+		err = posix_fallocate(of->fd, old, cap - old);
+	}
+
+	if(err == EOPNOTSUPP || err == EINVAL) {
+		if(ftruncate(of->fd, cap) == -1) {
+			perror("ftruncate");
+			return 0;
+		}
+	} else if(err != 0) {
+		errno = err;
+		perror("posix_fallocate");
+		/* Lo que alcanzo a reservar no se usa */
+		ftruncate(of->fd, old);
+		return 0;
+	}
+
+	o_mremap(of, cap / of->pagsize);
+	OFILE_CAPACITY(of) = cap;
+
+	return 1;
+}
+
+/* o_reserve(): Consigue el espacio de una entrada descrita por 'md', en un
+ * hueco libre o al final del fichero, y escribe su cabecera y nombre.
+ * Retorna el offset o 0 si falla. La memoria mapeada puede cambiar de direccion.
+ */
+static off_t o_reserve(o_file *of, const char *name, o_metadata *md)
+{
+	void *dst;
+	off_t offset;
+
+	if( !(offset = o_free_take(of, O_SZINFILE(md))) ) {
+		offset = OFILE_SIZE(of);
+
+		if(offset + O_SZINFILE(md) > OFILE_CAPACITY(of) && !o_grow(of, offset + O_SZINFILE(md)))
+			return 0;
+
+		OFILE_SIZE(of) += O_SZINFILE(md);
+	} else if(!O_ISSYS(md))
+		o_reused(of, offset);
+
+	dst = OADDR(of, offset);
+	memcpy(dst, md, sizeof(o_metadata));
+	dst = (caddr_t)dst + sizeof(o_metadata); 
+	memcpy(dst, name, O_NAMESIZE(md));
+	o_verified_clear(of, offset, 1);
+
+	return offset;
+}
+
+/* o_zdict(): Diccionario de compresion del fichero. Se usa una copia en
+ * memoria propia, la memoria mapeada se puede mover mientras se comprime.
+ * Retorna NULL si no hay.
+ */
+static const void *o_zdict(o_file *of, size_t *size)
+{
+	o_entry_view e;
+
+	if(!OHEADER(of)->dict)
+		return NULL;
+
+	if(!of->zdict.data || of->zdict.gen != OHEADER(of)->dict_gen) {
+		pthread_mutex_lock(&of->zdict.mutex);
+		if((!of->zdict.data || of->zdict.gen != OHEADER(of)->dict_gen) &&
+		   OHEADER(of)->dict && o_entry_at(of, OHEADER(of)->dict, &e)) {
+			free(of->zdict.data);
+			if(!(of->zdict.data = malloc(e.md.size))) {
+				perror("malloc");
+				exit(EXIT_FAILURE);
+			}
+			memcpy(of->zdict.data, e.data, e.md.size);
+			of->zdict.size = e.md.size;
+			of->zdict.gen = OHEADER(of)->dict_gen;
+			o_entry_put(of, &e);
+		}
+		pthread_mutex_unlock(&of->zdict.mutex);
+
+		if(!of->zdict.data)
+			return NULL;
+	}
+
+	*size = of->zdict.size;
+	return of->zdict.data;
+}
+
+/* o_pack(): En modo OF_COMPRESS comprime 'data', fuera de la modificacion.
+ * Retorna lo que se debe guardar: un bloque nuevo (tamano original y datos
+ * comprimidos) que el llamador libera, o 'data' si no se achica. En 'md'
+ * quedan el tamano a guardar, el codec y el CRC32C de lo guardado.
+ */
+static void *o_pack(o_file *of, void *data, size_t size, o_metadata *md)
+{
+	const void *dict;
+	size_t dictlen = 0, n;
+	uint64_t raw;
+	caddr_t buf;
+
+	md->size = size;
+	md->namelen &= ~O_MD_CODEC;
+	md->crc = ocore_crc32c(0, data, size);
+	md->reserved = 0;
+	if(!(of->opts & O_OPT_COMPRESS) || size < OFILE_Z_MIN)
+		return data;
+
+	if(!(buf = malloc(size))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Solo sirve si se guarda menos que 'size' */
+	dict = o_zdict(of, &dictlen);
+	n = ocore_lz_compress(data, size, buf + sizeof(uint64_t), size - sizeof(uint64_t) - 1, dict, dictlen);
+	if(n == 0) {
+		free(buf);
+		return data;
+	}
+
+	raw = size;
+	memcpy(buf, &raw, sizeof(uint64_t));
+	md->size = sizeof(uint64_t) + n;
+	md->crc = ocore_crc32c(0, buf, md->size);
+	md->namelen |= (uint64_t)(dict? O_CODEC_LZ_DICT : O_CODEC_LZ) << O_MD_CODEC_SHIFT;
+
+	return buf;
+}
+
+/* o_data_size(): Tamano original de los datos de la entrada */
+static size_t o_data_size(const o_entry_view *e)
+{
+	uint64_t raw;
+
+	if(O_CODEC(&e->md) == O_CODEC_NONE)
+		return e->md.size;
+	if(e->md.size < sizeof(uint64_t))
+		return 0;
+
+	memcpy(&raw, e->data, sizeof(uint64_t));
+	return raw;
+}
+
+/* o_unpack(): Descomprime en 'buf' hasta 'len' bytes de la entrada, desde
+ * 'pos'. Retorna los bytes copiados, 0 si los datos no son validos (un
+ * lector se pudo cruzar con un escritor). Solo una lectura desde 0 de todo
+ * el dato descomprime directo en 'buf'.
+ */
+static int o_unpack(o_file *of, const o_entry_view *e, void *buf, size_t pos, size_t len)
+{
+	caddr_t src = e->data + sizeof(uint64_t);
+	const void *dict = NULL;
+	size_t raw = o_data_size(e), dictlen = 0, n;
+	void *tmp;
+
+	/* Cada byte comprimido da a lo mas 255 */
+	if(raw == 0 || raw / 255 > e->md.size)
+		return 0;
+	if(O_CODEC(&e->md) == O_CODEC_LZ_DICT && !(dict = o_zdict(of, &dictlen)))
+		return 0;
+
+	n = e->md.size - sizeof(uint64_t);
+	if(pos == 0 && len >= raw)
+		return ocore_lz_decompress(src, n, buf, raw, dict, dictlen) == raw? raw : 0;
+
+	if(pos >= raw)
+		return 0;
+	if(len > raw - pos)
+		len = raw - pos;
+
+	if(!(tmp = malloc(raw))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	if(ocore_lz_decompress(src, n, tmp, raw, dict, dictlen) == raw)
+		memcpy(buf, (caddr_t)tmp + pos, len);
+	else
+		len = 0;
+	free(tmp);
+
+	return len;
+}
+
+/* o_write(): Escribe al final del fichero la nueva entrada
+ */
+static off_t o_write(o_file *of, const char *name, void *data, o_metadata *md)
+{
+	off_t offset;
+
+	if(!(offset = o_reserve(of, name, md)))
+		return 0;
+
+	memcpy(OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(md)), data, md->size);
+
+	return offset;
+}
+
+/* o_write_entry(): Verifica la existencia de una entrada con el mismo nombre, llama
+ * a o_write() y finalmente agrega la nueva entrada al indice.
+ */
+int o_write_entry(o_file *of, const char *name, void *data, size_t size)
+{
+	unsigned int h;
+	o_metadata md;
+	off_t offset;
+	void *stored;
+
+	if(size == 0 || !(of->flags & O_RDWR))
+		return 0;
+
+	md.namelen = strlen(name);
+	h = o_hash(name);
+	stored = o_pack(of, data, size, &md);
+
+	/* La busqueda va dentro de la modificacion, otro escritor puede agregar el nombre */
+	o_begin(of);
+	if( o_index_find(of, name, h) >= 0 || !o_index_reserve(of, 1) ||
+	    !(offset = o_write(of, name, stored, &md)) ) {
+		o_end(of);
+		if(stored != data)
+			free(stored);
+		return 0;
+	}
+
+	o_index_add(of, h, O_NAMELEN(&md), offset);
+	o_order_add(of, name);
+	OHEADER(of)->num++;
+
+	o_compact_auto(of);
+	o_end(of);
+	if(stored != data)
+		free(stored);
+	return size;
+}
+
+/* o_write_batch(): Escribe 'n' entradas de una vez. El fichero y el indice
+ * crecen una sola vez antes de copiar, y la cabecera se actualiza al final.
+ * Las entradas van al final del fichero, no se buscan huecos. Las que no se
+ * pueden escribir (tamano 0 o nombre repetido) quedan con offset 0.
+ * Retorna el numero de entradas escritas.
+ */
+int o_write_batch(o_file *of, o_batch_entry *e, int n)
+{
+	o_metadata *md;
+	off_t offset;
+	size_t need = 0;
+	unsigned int h;
+	int i, count = 0, written = 0;
+	caddr_t dst;
+	void **stored;
+
+	if(!(of->flags & O_RDWR) || n <= 0)
+		return 0;
+
+	/* Se comprime antes de la modificacion */
+	md = malloc(n * sizeof(o_metadata));
+	stored = malloc(n * sizeof(void *));
+	if(!md || !stored) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0; i < n; i++) {
+		md[i].namelen = strlen(e[i].name);
+		stored[i] = e[i].size? o_pack(of, e[i].data, e[i].size, &md[i]) : e[i].data;
+	}
+
+	o_begin(of);
+	for(i = 0; i < n; i++) {
+		e[i].offset = 0;
+		if(e[i].size == 0 || o_lookup(of, e[i].name))
+			continue;
+		need += sizeof(o_metadata) + O_NAMESIZE(&md[i]) + md[i].size;
+		count++;
+	}
+
+	if(count == 0 || !o_index_reserve(of, count) ||
+	   (OFILE_SIZE(of) + need > OFILE_CAPACITY(of) && !o_grow(of, OFILE_SIZE(of) + need))) {
+		o_end(of);
+		goto out;
+	}
+
+	offset = OFILE_SIZE(of);
+	for(i = 0; i < n; i++) {
+		if(e[i].size == 0)
+			continue;
+
+		/* Un nombre repetido dentro del lote se detecta aqui, la entrada
+		 * anterior ya esta escrita y en el indice.
+		 */
+		h = o_hash(e[i].name);
+		if(o_index_find(of, e[i].name, h) >= 0)
+			continue;
+
+		dst = OADDR(of, offset);
+		memcpy(dst, &md[i], sizeof(o_metadata));
+		memcpy(dst + sizeof(o_metadata), e[i].name, O_NAMESIZE(&md[i]));
+		memcpy(dst + sizeof(o_metadata) + O_NAMESIZE(&md[i]), stored[i], md[i].size);
+
+		o_index_add(of, h, O_NAMELEN(&md[i]), offset);
+		o_order_add(of, e[i].name);
+		o_verified_clear(of, offset, 1);
+		e[i].offset = offset;
+		offset += O_SZINFILE(&md[i]);
+		written++;
+	}
+
+	OFILE_SIZE(of) = offset;
+	OHEADER(of)->num += written;
+
+	o_compact_auto(of);
+	o_end(of);
+out:
+	for(i = 0; i < n; i++)
+		if(stored[i] != e[i].data)
+			free(stored[i]);
+	free(stored);
+	free(md);
+	return written;
+}
+
+/* o_md_read(): Copia en 'buf' hasta 'len' bytes de los datos de la entrada,
+ * desde 'pos'. 'e' debe venir de o_entry_at(). Retorna los bytes copiados.
+ */
+static int o_md_read(o_file *of, const o_entry_view *e, void *buf, size_t pos, size_t len)
+{
+	if(len <= 0)
+		return 0;
+
+	if(O_CODEC(&e->md))
+		return o_unpack(of, e, buf, pos, len);
+
+	/* Nunca mas que los datos ni que el buffer */
+	if(pos >= e->md.size)
+		return 0;
+	if(len > e->md.size - pos)
+		len = e->md.size - pos;
+
+	memcpy(buf, e->data + pos, len);
+
+	return len;
+}
+
+/* o_read_entry(): Busca la entrada en el indice y llama a o_md_read().
+ */
+int o_read_entry(o_file *of, const char *name, void *buf, size_t len) 
+{
+	return o_entry_read(of, name, buf, 0, len);
+}
+
+/* o_entry_read(): Copia hasta 'len' bytes de los datos de la entrada desde
+ * 'pos', asi una entrada grande se lee por partes sin otro buffer. Las
+ * entradas comprimidas se descomprimen enteras en cada llamada. Retorna los
+ * bytes copiados, 0 al final de los datos.
+ */
+int o_entry_read(o_file *of, const char *name, void *buf, size_t pos, size_t len)
+{
+	o_entry_view e;
+	off_t offset;
+	long gen;
+	int ret, bad;
+
+	do {
+		if((gen = o_read_begin(of)) < 0)
+			return 0;
+
+		ret = bad = 0;
+		if( (offset = o_lookup(of, name)) && o_entry_at(of, offset, &e) ) {
+			if(o_md_good(of, offset, &e))
+				ret = o_md_read(of, &e, buf, pos, len);
+			else
+				bad = 1;
+			o_entry_put(of, &e);
+		}
+	} while(o_read_retry(of, gen));
+
+	if(bad)
+		fprintf(stderr, "%s(): \"%s\" is corrupted\n", __FUNCTION__, name);
+
+	return ret;
+}
+
+/* o_delete(): Marca la entrada como eliminada. El espacio se recupera
+ * despues, con la compactacion.
+ */
+static void o_delete(o_file *of, off_t offset)
+{
+	o_metadata *md, *next;
+	size_t size;
+
+	md = (o_metadata *)OADDR(of, offset);
+	md->namelen |= O_MD_DEAD;
+	size = O_SZINFILE(md);
+
+	OHEADER(of)->dead += size;
+
+	/* Se une con el hueco que le sigue, si lo hay. El hueco de una
+	 * compactacion en curso no se toca: la pasada sigue desde su comienzo.
+	 */
+	if(offset + size < OFILE_SIZE(of) && !(OHEADER(of)->compacting &&
+	   (offset + size == OHEADER(of)->compact_dst || offset + size == OHEADER(of)->compact_src))) {
+		next = (o_metadata *)OADDR(of, offset + size);
+		if(O_ISFREE(next)) {
+			o_free_unlink(of, offset + size);
+			size += O_SZINFILE(next);
+		}
+	}
+
+	if(size >= O_FREE_MIN)
+		o_free_add(of, offset, size);
+}
+
+/* o_index_shift(): Las entradas en [offset, offset + len) llegaron ahi
+ * desde 'delta' bytes mas adelante, se corrigen sus slots.
+ */
+static void o_index_shift(o_file *of, off_t offset, size_t len, off_t delta)
+{
+	o_index_slot *slots = o_index(of);
+	off_t end = offset + len;
+	o_metadata *md;
+
+	for(; offset < end; offset += O_SZINFILE(md)) {
+		md = (o_metadata *)OADDR(of, offset);
+		slots[o_index_slot_of(of, o_hash((char *)md + sizeof(o_metadata)), offset + delta)].offset = offset;
+	}
+}
+
+/* o_compact_step(): Avanza la compactacion en curso, revisando a lo mas
+ * 'budget' bytes (0 = sin limite). Las entradas vivas se mueven hacia 'dst'
+ * y las eliminadas se saltan. Cada tramo de entradas vivas seguidas se mueve
+ * con un solo memmove() y luego se corrigen sus slots.
+ *
+ * 	     E	    M	   M			   	 
+ *  |------|------|------|------|	|------|------|------|
+ *  |  1   |  2o<----3o<----4o  | ---->  |  1   |  3   |	 4   |
+ *  |------|------|------|------|	|------|------|------|
+ *
+ * Retorna 1 si la compactacion sigue pendiente.
+ */
+static int o_compact_step(o_file *of, size_t budget)
+{
+	o_metadata *md;
+	size_t work = 0, sz;
+	off_t from, end;
+
+	/* Las entradas cambian de lugar, los lectores con indice propio deben
+	 * reconstruirlo (o_refresh())
+	 */
+	OHEADER(of)->epoch++;
+
+	while(OHEADER(of)->compact_src < OFILE_SIZE(of) && (budget == 0 || work < budget)) {
+		md = (o_metadata *)OADDR(of, OHEADER(of)->compact_src);
+		sz = O_SZINFILE(md);
+
+		if(O_ISDEAD(md)) {
+			/* El hueco desaparece, no puede seguir en las listas */
+			if(O_ISFREE(md))
+				o_free_unlink(of, OHEADER(of)->compact_src);
+			work += sizeof(o_metadata);
+			OHEADER(of)->compact_src += sz;
+			continue;
+		}
+
+		if(O_ISSYS(md)) {
+			if(OHEADER(of)->compact_src != OHEADER(of)->compact_dst &&
+			   OHEADER(of)->compact_src == OHEADER(of)->index) {
+				/* El indice se mueve entero y sus slots se vuelven a alinear */
+				from = (caddr_t)O_INDEX_AT(of, OHEADER(of)->compact_src) - OADDR(of, OHEADER(of)->compact_src);
+				memmove(OADDR(of, OHEADER(of)->compact_dst), md, sz);
+				memmove(O_INDEX_AT(of, OHEADER(of)->compact_dst), OADDR(of, OHEADER(of)->compact_dst + from),
+					OHEADER(of)->index_size * sizeof(o_index_slot));
+				OHEADER(of)->index = OHEADER(of)->compact_dst;
+			} else if(OHEADER(of)->compact_src != OHEADER(of)->compact_dst) {
+				memmove(OADDR(of, OHEADER(of)->compact_dst), md, sz);
+				/* El diccionario de compresion */
+				if(OHEADER(of)->compact_src == OHEADER(of)->dict)
+					OHEADER(of)->dict = OHEADER(of)->compact_dst;
+			}
+			OHEADER(of)->compact_dst += sz;
+			OHEADER(of)->compact_src += sz;
+			work += sz;
+			continue;
+		}
+
+		/* Tramo de entradas vivas seguidas */
+		end = OHEADER(of)->compact_src + sz;
+		work += sz;
+		while(end < OFILE_SIZE(of) && (budget == 0 || work < budget)) {
+			md = (o_metadata *)OADDR(of, end);
+			if(O_ISDEAD(md) || O_ISSYS(md))
+				break;
+			end += O_SZINFILE(md);
+			work += O_SZINFILE(md);
+		}
+
+		if(OHEADER(of)->compact_src != OHEADER(of)->compact_dst) {
+			memmove(OADDR(of, OHEADER(of)->compact_dst), OADDR(of, OHEADER(of)->compact_src), end - OHEADER(of)->compact_src);
+			o_verified_clear(of, OHEADER(of)->compact_dst, end - OHEADER(of)->compact_src);
+			o_index_shift(of, OHEADER(of)->compact_dst, end - OHEADER(of)->compact_src,
+				OHEADER(of)->compact_src - OHEADER(of)->compact_dst);
+		}
+		OHEADER(of)->compact_dst += end - OHEADER(of)->compact_src;
+		OHEADER(of)->compact_src = end;
+	}
+
+	if(OHEADER(of)->compact_src < OFILE_SIZE(of)) {
+		if(OHEADER(of)->compact_src == OHEADER(of)->compact_dst)
+			return 1;
+
+		/* El hueco [dst, src) queda como una entrada eliminada, asi el
+		 * fichero se puede seguir recorriendo entrada por entrada.
+		 */
+		o_put_dead(of, OHEADER(of)->compact_dst, OHEADER(of)->compact_src - OHEADER(of)->compact_dst);
+		return 1;
+	}
+
+	/* Fin de la pasada, se recorta el fichero */
+	OHEADER(of)->dead -= OHEADER(of)->compact_src - OHEADER(of)->compact_dst;
+	OFILE_SIZE(of) = OHEADER(of)->compact_dst;
+	OHEADER(of)->compacting = 0;
+
+	/* En modo compartido el fichero no se achica, otro proceso puede estar
+	 * leyendo mas alla del nuevo final. El espacio queda reservado.
+	 */
+	if(!(of->opts & O_OPT_SHARED)) {
+		ftruncate(of->fd, OFILE_SIZE(of));
+		OFILE_CAPACITY(of) = OFILE_SIZE(of);
+		o_mremap(of, OFILE_PAGES(of));
+	}
+
+	return 0;
+}
+
+static void o_compact_start(o_file *of)
+{
+	OHEADER(of)->compact_src = O_HEADERSIZE;
+	OHEADER(of)->compact_dst = O_HEADERSIZE;
+	OHEADER(of)->compacting = 1;
+}
+
+/* o_compact_auto(): Llamada despues de cada modificacion. Inicia una pasada
+ * si hay demasiado espacio eliminado, y avanza la que este en curso.
+ */
+static void o_compact_auto(o_file *of)
+{
+	/* Los escritores por partes escriben sin o_begin(), su espacio no se mueve */
+	if(OHEADER(of)->streams)
+		return;
+
+	if(!OHEADER(of)->compacting) {
+		if(OHEADER(of)->dead * 100 < OFILE_SIZE(of) * OFILE_COMPACT_RATIO)
+			return;
+		o_compact_start(of);
+	}
+
+	o_compact_step(of, OFILE_COMPACT_STEP);
+}
+
+/* o_compact(): Compacta el fichero revisando a lo mas 'budget' bytes por
+ * llamada (0 = hasta terminar). Retorna 1 si aun queda trabajo pendiente.
+ */
+int o_compact(o_file *of, size_t budget)
+{
+	int ret;
+
+	if(!(of->flags & O_RDWR) || OHEADER(of)->streams)
+		return 0;
+	if(!OHEADER(of)->compacting && OHEADER(of)->dead == 0)
+		return 0;
+
+	/* La pasada comienza con el lock y la generacion impar, en modo
+	 * compartido nadie la ve a medio comenzar. Otro proceso pudo abrir un
+	 * escritor por partes, o terminar la pasada.
+	 */
+	o_begin(of);
+	ret = 0;
+	if(!OHEADER(of)->streams && (OHEADER(of)->compacting || OHEADER(of)->dead)) {
+		if(!OHEADER(of)->compacting)
+			o_compact_start(of);
+		ret = o_compact_step(of, budget);
+	}
+	o_end(of);
+
+	return ret;
+}
+
+/* o_compact_progress(): Porcentaje revisado de la pasada en curso, -1 si no
+ * hay compactacion pendiente.
+ */
+int o_compact_progress(o_file *of)
+{
+	size_t total = OFILE_SIZE(of) - O_HEADERSIZE;
+
+	if(!OHEADER(of)->compacting)
+		return -1;
+
+	return total? (OHEADER(of)->compact_src - O_HEADERSIZE) * 100 / total : 100;
+}
+
+/* o_room(): Bytes que puede ocupar la entrada en 'offset' sin moverse, ella
+ * mas las entradas eliminadas que la siguen. El hueco de una compactacion
+ * en curso no se toca.
+ */
+static size_t o_room(o_file *of, off_t offset)
+{
+	size_t room = O_SZINFILE((o_metadata *)OADDR(of, offset));
+	o_metadata *next;
+
+	while(offset + room < OFILE_SIZE(of)) {
+		if(OHEADER(of)->compacting && offset + room == OHEADER(of)->compact_dst)
+			break;
+		next = (o_metadata *)OADDR(of, offset + room);
+		if(!O_ISDEAD(next))
+			break;
+		room += O_SZINFILE(next);
+	}
+
+	return room;
+}
+
+/* o_update(): Ajusta la entrada en 'offset' a 'pk->size' bytes de datos dentro de
+ * 'room' bytes (ver o_room()). Lo que sobra queda como holgura para crecer
+ * despues, o vuelve a las listas de huecos si es mucho.
+ */
+static void o_update(o_file *of, off_t offset, size_t room, void *data, const o_metadata *pk)
+{
+	o_metadata *md = (o_metadata *)OADDR(of, offset), *next;
+	size_t sz = O_SZINFILE(md), need;
+	off_t pos;
+
+	/* Las entradas eliminadas absorbidas dejan de serlo */
+	for(pos = offset + sz; pos < offset + room; pos += O_SZINFILE(next)) {
+		next = (o_metadata *)OADDR(of, pos);
+		if(O_ISFREE(next))
+			o_free_unlink(of, pos);
+		OHEADER(of)->dead -= O_SZINFILE(next);
+	}
+
+	/* Tamano y codec de o_pack() */
+	md->size = pk->size;
+	md->namelen = (md->namelen & ~O_MD_CODEC) | (pk->namelen & O_MD_CODEC);
+	md->crc = pk->crc;
+	o_verified_clear(of, offset, 1);
+	need = O_SZINFILE(md);
+	memcpy(OADDR(of, offset + need - pk->size), data, pk->size);
+
+	if(room > need) {
+		if(room - need > need / OFILE_UPDATE_SLACK && room - need >= O_FREE_MIN)
+			o_free_add(of, offset + need, room - need);
+		else
+			o_put_dead(of, offset + need, room - need);
+		OHEADER(of)->dead += room - need;
+	}
+}
+
+/* o_update_entry(): Cambia los datos de una entrada existente. Si caben en el
+ * espacio que ocupa (y la holgura que la sigue) se escriben ahi mismo. Si no,
+ * la entrada se mueve a un lugar con holgura para crecer, y solo cambia su
+ * slot en el indice.
+ */
+int o_update_entry(o_file *of, const char *name, void *data, size_t size)
+{
+	o_metadata md, *md_p, pk;
+	size_t room, need, slack;
+	off_t offset, src;
+	void *stored;
+	long i;
+
+	if(size == 0 || !(of->flags & O_RDWR))
+		return 0;
+
+	pk.namelen = 0;
+	stored = o_pack(of, data, size, &pk);
+
+	o_begin(of);
+	if((i = o_index_find(of, name, o_hash(name))) < 0) {
+		o_end(of);
+		if(stored != data)
+			free(stored);
+		return 0;
+	}
+
+	src = o_index(of)[i].offset;
+	md_p = (o_metadata *)OADDR(of, src);
+	need = sizeof(o_metadata) + O_NAMESIZE(md_p) + pk.size;
+	room = o_room(of, src);
+
+	if(need == room || need + O_DEAD_MIN <= room) {
+		o_update(of, src, room, stored, &pk);
+	} else {
+		slack = need / OFILE_UPDATE_SLACK;
+		if(slack < O_DEAD_MIN)
+			slack = O_DEAD_MIN;
+
+		md.namelen = O_NAMELEN(md_p);
+		md.size = pk.size + slack;
+		md.crc = md.reserved = 0;
+
+		if(!(offset = o_reserve(of, name, &md))) {
+			o_end(of);
+			if(stored != data)
+				free(stored);
+			return 0;
+		}
+		/* Se conserva el nombre guardado, 'name' puede diferir en mayusculas */
+		memcpy(OADDR(of, offset + sizeof(o_metadata)), OADDR(of, src + sizeof(o_metadata)), md.namelen);
+
+		/* La holgura al final queda como entrada eliminada */
+		o_update(of, offset, O_SZINFILE(&md), stored, &pk);
+
+		o_delete(of, src);
+		o_index(of)[i].offset = offset;
+	}
+
+	o_compact_auto(of);
+	o_end(of);
+	if(stored != data)
+		free(stored);
+	return size;
+}
+
+int o_delete_entry(o_file *of, const char *name)
+{
+	off_t offset;
+	long i;
+
+	if(!(of->flags & O_RDWR))
+		return 0;
+
+	o_begin(of);
+	if((i = o_index_find(of, name, o_hash(name))) < 0) {
+		o_end(of);
+		return 0;
+	}
+
+	offset = o_index(of)[i].offset;
+	o_order_del(of, name);
+	o_index_drop(of, i);
+	o_delete(of, offset);
+	OHEADER(of)->num -= 1; /* Numero de elementos disminuye en 1 */
+
+	o_compact_auto(of);
+	o_end(of);
+	return 1;
+}
+
+int o_rename_entry(o_file *of, const char *old, const char *new)
+{
+	void *dst;
+	unsigned int h;
+	off_t offset, src;
+	o_metadata md, *md_p;
+	long i;
+
+	if(!(of->flags & O_RDWR))
+		return 0;
+
+	h = o_hash(new);
+
+	/* El slot cambia con el hash del nombre, se busca despues de reservar */
+	o_begin(of);
+	if(o_index_find(of, old, o_hash(old)) < 0 || o_index_find(of, new, h) >= 0 ||
+	   !o_index_reserve(of, 1)) {
+		o_end(of);
+		return 0;
+	}
+	i = o_index_find(of, old, o_hash(old));
+	src = o_index(of)[i].offset;
+
+	md_p = (o_metadata *)OADDR(of, src);
+	md.namelen = strlen(new);
+	md.size = md_p->size;
+
+	/* Cuando los nombres son del mismo tamao,
+	 * solo escribo el nuevo sobre el viejo.
+	 */
+	if(md.namelen == O_NAMELEN(md_p)) {
+		/* Escribo el nuevo nombre */
+		dst = OADDR(of, src + sizeof(o_metadata));
+		memcpy(dst, new, md.namelen);
+		offset = src;
+		o_reused(of, offset);
+	} else {
+		/* Los datos se copian tal cual, comprimidos o no */
+		md.namelen |= md_p->namelen & O_MD_CODEC;
+		md.crc = md_p->crc;
+		md.reserved = 0;
+
+		/* Lo siguiente es escribir la informacion otra vez pero con el nuevo
+	 	 * nombre y finalmente eliminar la vieja entrada. De esta forma me aseguro de no perder
+		 * informacion. La forma errada es rescatar, eliminar, escribir.
+		 * o_reserve() puede mover la memoria mapeada, los datos se copian despues.
+		 */
+		if(!(offset = o_reserve(of, new, &md))) {
+			/* No fue posible cambiar de nombre, se mantiene el viejo */
+			o_end(of);
+			return 0;
+		}
+
+		memcpy(OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(&md)),
+			o_access_to_mem(of, src, NULL), md.size);
+
+		o_delete(of, src);
+	}
+
+	o_index_drop(of, i);
+	o_index_add(of, h, O_NAMELEN(&md), offset);
+	o_order_del(of, old);
+	o_order_add(of, new);
+
+	o_compact_auto(of);
+	o_end(of);
+	return 1;
+}
+
+typedef struct {
+	off_t offset;
+	size_t sz; /* tamano en el fichero, de la copia de la metadata */
+	int i;
+	int bad;
+} o_multi_hit;
+
+static int o_multi_cmp(const void *a, const void *b)
+{
+	const o_multi_hit *x = a, *y = b;
+
+	return x->offset < y->offset? -1 : x->offset > y->offset? 1 : 0;
+}
+
+/* o_read_entries(): Lee 'n' entradas de una vez. Primero busca todos los
+ * nombres, ordena las encontradas por offset y pide al sistema
+ * (MADV_WILLNEED) los tramos que ocupan, uniendo los que estan a menos de
+ * OFILE_MULTI_GAP bytes. Luego las copia en ese orden, asi las fallas de
+ * pagina quedan casi secuenciales. Con e[i].data NULL no se copia, e[i].view
+ * apunta a los datos en la memoria mapeada (solo entradas sin comprimir,
+ * sirven hasta la siguiente modificacion). Retorna cuantas se leyeron, -1
+ * con ventanas (errno ENOTSUP).
+ */
+int o_read_entries(o_file *of, o_read_batch *e, int n)
+{
+	o_multi_hit *hits;
+	o_entry_view at;
+	off_t start, end, next;
+	long gen;
+	int i, k, found, ret;
+
+	if(n <= 0)
+		return 0;
+
+	/* Las vistas y el MADV_WILLNEED son de la memoria mapeada */
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	if(!(hits = malloc(n * sizeof(o_multi_hit)))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	do {
+		if((gen = o_read_begin(of)) < 0) {
+			free(hits);
+			return 0;
+		}
+
+		for(i = found = 0; i < n; i++) {
+			e[i].view = NULL;
+			e[i].len = 0;
+			e[i].offset = 0;
+			if( (hits[found].offset = o_lookup(of, e[i].name)) && o_entry_at(of, hits[found].offset, &at) ) {
+				hits[found].sz = at.data - at.head + at.md.size;
+				hits[found].i = i;
+				hits[found++].bad = 0;
+			}
+		}
+		qsort(hits, found, sizeof(o_multi_hit), o_multi_cmp);
+
+		for(k = 0; k < found; k = i) {
+			start = hits[k].offset - hits[k].offset % of->pagsize;
+			end = hits[k].offset + hits[k].sz;
+			for(i = k + 1; i < found && hits[i].offset < end + OFILE_MULTI_GAP; i++) {
+				next = hits[i].offset + hits[i].sz;
+				if(next > end)
+					end = next;
+			}
+			if(end > OMAPPED(of))
+				end = OMAPPED(of);
+			madvise(OADDR(of, start), end - start, MADV_WILLNEED);
+		}
+
+		for(k = ret = 0; k < found; k++) {
+			i = hits[k].i;
+			if(!o_entry_at(of, hits[k].offset, &at))
+				continue;
+			if(!o_md_good(of, hits[k].offset, &at)) {
+				hits[k].bad = 1;
+				continue;
+			}
+
+			if(e[i].data)
+				e[i].len = o_md_read(of, &at, e[i].data, 0, e[i].size);
+			else if(!O_CODEC(&at.md)) {
+				e[i].view = at.data;
+				e[i].len = at.md.size;
+			}
+			if(e[i].len) {
+				e[i].offset = hits[k].offset;
+				ret++;
+			}
+		}
+	} while(o_read_retry(of, gen));
+
+	for(k = 0; k < found; k++)
+		if(hits[k].bad)
+			fprintf(stderr, "%s(): \"%s\" is corrupted\n", __FUNCTION__, e[hits[k].i].name);
+	free(hits);
+
+	return ret;
+}
+
+/* o_stream_valid(): El espacio del escritor sigue siendo suyo. o_clean_up(),
+ * de este u otro proceso, lo pudo eliminar. 'reserved' del espacio guarda el
+ * pid del proceso dueno. Se llama dentro de la modificacion.
+ */
+static int o_stream_valid(o_entry_writer *w)
+{
+	o_file *of = w->of;
+	o_metadata *md;
+	size_t len = strlen(w->name);
+
+	if(w->offset == 0 || w->offset + sizeof(o_metadata) + len + 1 > OFILE_SIZE(of))
+		return 0;
+
+	md = (o_metadata *)OADDR(of, w->offset);
+	return O_ISSYS(md) && !O_ISDEAD(md) && O_NAMELEN(md) == len && md->reserved == (uint32_t)getpid() &&
+		memcmp(OADDR(of, w->offset + sizeof(o_metadata)), w->name, len) == 0;
+}
+
+/* o_stream_reap(): Recuenta los escritores por partes en modo compartido.
+ * El espacio de los procesos que terminaron sin cerrar sus escritores se
+ * libera, si no la compactacion esperaria para siempre. Se llama dentro de
+ * la modificacion.
+ */
+static void o_stream_reap(o_file *of)
+{
+	o_file_header *header = OHEADER(of);
+	o_metadata *md;
+	off_t offset = O_HEADERSIZE;
+	size_t sz;
+	int n = 0;
+
+	while(offset < OFILE_SIZE(of)) {
+		md = (o_metadata *)OADDR(of, offset);
+		sz = O_SZINFILE(md);
+		if(O_ISSYS(md) && !O_ISDEAD(md) && O_NAMELEN(md) && offset != header->dict) {
+			if(md->reserved && kill((pid_t)md->reserved, 0) == -1 && errno == ESRCH)
+				o_delete(of, offset);
+			else
+				n++;
+		}
+		offset += sz;
+	}
+	header->streams = n;
+}
+
+/* o_stream_move(): Lleva el espacio de un escritor por partes a una entrada
+ * nueva con lugar para 'size' bytes, junto con lo ya escrito. Se llama
+ * dentro de la modificacion.
+ */
+static int o_stream_move(o_entry_writer *w, size_t size)
+{
+	o_file *of = w->of;
+	o_metadata md;
+	off_t offset;
+
+	md.size = size;
+	md.namelen = strlen(w->name) | O_MD_SYS;
+	md.crc = 0;
+	md.reserved = getpid();
+	if(!(offset = o_reserve(of, w->name, &md)))
+		return 0;
+
+	memcpy(OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(&md)),
+		OADDR(of, w->offset + sizeof(o_metadata) + O_NAMESIZE(&md)), w->used);
+	o_delete(of, w->offset);
+
+	w->offset = offset;
+	w->size = size;
+	return 1;
+}
+
+/* o_stream_close(): Libera el espacio del escritor (si 'drop') y el escritor.
+ * Sin 'drop' el espacio ya es una entrada. Un escritor invalido ya no cuenta.
+ * Se llama dentro de la modificacion.
+ */
+static void o_stream_close(o_entry_writer *w, int drop)
+{
+	o_entry_writer **p;
+
+	if(drop && !o_stream_valid(w))
+		w->offset = 0;
+	if(w->offset) {
+		if(drop)
+			o_delete(w->of, w->offset);
+		OHEADER(w->of)->streams--;
+	}
+
+	for(p = &w->of->writers; *p != w; p = &(*p)->next);
+	*p = w->next;
+	free(w->name);
+	free(w);
+}
+
+/* o_entry_open_write(): Comienza a escribir la entrada 'name' por partes.
+ * Se reservan 'hint' bytes (el tamano esperado, 0 si no se sabe) que crecen
+ * al doble si no alcanzan. Mientras haya escritores abiertos el fichero no
+ * se compacta. Retorna NULL si la entrada ya existe.
+ */
+o_entry_writer *o_entry_open_write(o_file *of, const char *name, size_t hint)
+{
+	o_entry_writer *w;
+	o_metadata md;
+	off_t offset;
+
+	if(!(of->flags & O_RDWR))
+		return NULL;
+
+	md.size = hint? hint : OFILE_STREAM_CHUNK;
+	md.namelen = strlen(name) | O_MD_SYS;
+	md.crc = 0;
+	md.reserved = getpid();
+
+	if(!(w = calloc(1, sizeof(o_entry_writer))) || !(w->name = strdup(name))) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	o_begin(of);
+	if( o_index_find(of, name, o_hash(name)) >= 0 || !(offset = o_reserve(of, name, &md)) ) {
+		o_end(of);
+		free(w->name);
+		free(w);
+		return NULL;
+	}
+	OHEADER(of)->streams++;
+	w->of = of;
+	w->offset = offset;
+	w->size = md.size;
+	w->next = of->writers;
+	of->writers = w;
+	o_end(of);
+
+	return w;
+}
+
+/* o_entry_append(): Agrega 'len' bytes al final de la entrada. Retorna los
+ * bytes escritos, 0 si no hubo espacio.
+ */
+int o_entry_append(o_entry_writer *w, const void *data, size_t len)
+{
+	o_file *of = w->of;
+	size_t size;
+	int ok;
+
+	if(len == 0)
+		return 0;
+
+	if(len > w->size - w->used) {
+		size = w->size * 2;
+		if(size < w->used + len)
+			size = w->used + len;
+
+		o_begin(of);
+		ok = o_stream_valid(w) && o_stream_move(w, size);
+		o_end(of);
+		if(!ok)
+			return 0;
+	}
+
+	/* Nadie mas usa el espacio reservado, basta con que la memoria mapeada
+	 * no se mueva mientras se copia. En modo compartido el flock()
+	 * compartido impide que otro proceso lo elimine con o_clean_up().
+	 */
+	pthread_mutex_lock(&of->lock);
+	if(of->opts & O_OPT_SHARED)
+		flock(of->fd, LOCK_SH);
+	ok = o_stream_valid(w);
+	if(ok)
+		memcpy(OADDR(of, w->offset + sizeof(o_metadata) + strlen(w->name) + 1 + w->used), data, len);
+	if(of->opts & O_OPT_SHARED)
+		flock(of->fd, LOCK_UN);
+	pthread_mutex_unlock(&of->lock);
+	if(!ok)
+		return 0;
+
+	w->crc = ocore_crc32c(w->crc, data, len);
+	w->used += len;
+
+	return len;
+}
+
+/* o_entry_commit(): Hace visible la entrada con lo escrito y termina el
+ * escritor. Lo reservado que sobra vuelve a las listas de huecos. Si falla
+ * (no se escribio nada o el nombre ya existe) es igual que o_entry_abort().
+ * Retorna el tamano de la entrada o 0.
+ */
+int o_entry_commit(o_entry_writer *w)
+{
+	o_file *of = w->of;
+	o_metadata *md, *next;
+	unsigned int h = o_hash(w->name);
+	size_t left, namesize = strlen(w->name) + 1;
+	off_t tail;
+	int ret;
+
+	o_begin(of);
+	if(!o_stream_valid(w) || w->used == 0 || o_index_find(of, w->name, h) >= 0 || !o_index_reserve(of, 1)) {
+		o_stream_close(w, 1);
+		o_end(of);
+		return 0;
+	}
+
+	/* Lo que sobra debe alcanzar para una entrada eliminada, o estar al
+	 * final del fichero, o unirse a la entrada eliminada que sigue. Si no,
+	 * la entrada se mueve a un lugar justo.
+	 */
+	left = w->size - w->used;
+	tail = w->offset + sizeof(o_metadata) + namesize + w->used;
+	if(left > 0 && left < O_DEAD_MIN && tail + left < OFILE_SIZE(of)) {
+		next = (o_metadata *)OADDR(of, tail + left);
+		if( (!O_ISDEAD(next) || (OHEADER(of)->compacting && tail + left == OHEADER(of)->compact_dst)) &&
+		    !o_stream_move(w, w->used) ) {
+			o_stream_close(w, 1);
+			o_end(of);
+			return 0;
+		}
+		left = w->size - w->used;
+		tail = w->offset + sizeof(o_metadata) + namesize + w->used;
+	}
+
+	md = (o_metadata *)OADDR(of, w->offset);
+	md->namelen = O_NAMELEN(md);
+	md->size = w->used;
+	md->crc = w->crc;
+	md->reserved = 0;
+	o_verified_clear(of, w->offset, 1);
+	/* Un lector pudo saltarse la reserva, se anota como reutilizada */
+	o_reused(of, w->offset);
+
+	if(left > 0 && tail + left == OFILE_SIZE(of))
+		OFILE_SIZE(of) = tail;
+	else if(left > 0) {
+		if(left < O_DEAD_MIN) {
+			next = (o_metadata *)OADDR(of, tail + left);
+			if(O_ISFREE(next))
+				o_free_unlink(of, tail + left);
+			OHEADER(of)->dead -= O_SZINFILE(next);
+			left += O_SZINFILE(next);
+		}
+		if(left >= O_FREE_MIN)
+			o_free_add(of, tail, left);
+		else
+			o_put_dead(of, tail, left);
+		OHEADER(of)->dead += left;
+	}
+
+	o_index_add(of, h, O_NAMELEN(md), w->offset);
+	o_order_add(of, w->name);
+	OHEADER(of)->num++;
+
+	ret = w->used;
+	o_stream_close(w, 0);
+
+	o_compact_auto(of);
+	o_end(of);
+	return ret;
+}
+
+/* o_entry_abort(): Descarta lo escrito y termina el escritor */
+void o_entry_abort(o_entry_writer *w)
+{
+	o_file *of = w->of;
+
+	o_begin(of);
+	o_stream_close(w, 1);
+	o_end(of);
+}
+
+off_t o_get_offset(o_file *of, const char *name)
+{
+	off_t offset;
+	long gen;
+
+	do {
+		if((gen = o_read_begin(of)) < 0)
+			return 0;
+		offset = o_lookup(of, name);
+	} while(o_read_retry(of, gen));
+
+	return offset;
+}
+
+/* o_access_to_mem(): Direccion de los datos de la entrada en 'offset'.
+ * Con ventanas retorna NULL (errno ENOTSUP): nada fijaria la ventana, se
+ * usa o_pin_mem().
+ */
+void *o_access_to_mem(o_file *of, off_t offset, size_t *size)
+{
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	return o_pin_mem(of, offset, size);
+}
+
+/* o_pin_mem(): Como o_access_to_mem(), con ventanas la ventana queda fijada
+ * hasta o_release_mem().
+ */
+void *o_pin_mem(o_file *of, off_t offset, size_t *size)
+{
+	o_entry_view e;
+
+	if(offset < O_FIRST(of) || offset > OFILE_SIZE(of))
+		return NULL;
+
+	if(!o_entry_at(of, offset, &e))
+		return NULL;
+	if(size)
+		*size = e.md.size;
+
+	return e.data;
+}
+ 
+/* o_send_data(): write() de 'len' bytes hasta terminar. Retorna los bytes
+ * escritos.
+ */
+static size_t o_send_data(int out, const void *data, size_t len)
+{
+	size_t sent = 0;
+	ssize_t n;
+
+	while(sent < len) {
+		n = write(out, (const char *)data + sent, len - sent);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		sent += n;
+	}
+
+	return sent;
+}
+
+/* o_send_entry(): Escribe en 'out' hasta 'len' bytes de los datos de la
+ * entrada desde 'pos' (0 = hasta el final), con sendfile() desde el
+ * descriptor del fichero: los datos no pasan por la memoria del proceso.
+ * Las entradas comprimidas se descomprimen y se escriben con write(). En
+ * modo compartido los escritores esperan hasta terminar de enviar. Con
+ * ventanas solo el metadata pasa por una. Retorna los bytes enviados, -1 si
+ * la entrada no existe o no se pudo escribir.
+ */
+ssize_t o_send_entry(o_file *of, const char *name, int out, off_t pos, size_t len)
+{
+	off_t offset, from = 0;
+	o_entry_view e;
+	size_t size = 0, want, sent;
+	ssize_t n;
+	long gen;
+	int codec = 0, bad, locked;
+	void *buf;
+
+	if(pos < 0)
+		return -1;
+
+	do {
+		do {
+			if((gen = o_read_begin(of)) < 0)
+				return -1;
+
+			bad = 0;
+			if( (offset = o_lookup(of, name)) && o_entry_at(of, offset, &e) ) {
+				if(o_md_good(of, offset, &e)) {
+					codec = O_CODEC(&e.md);
+					size = o_data_size(&e);
+					from = offset + (e.data - e.head);
+				} else
+					bad = 1;
+				o_entry_put(of, &e);
+			}
+		} while(o_read_retry(of, gen));
+
+		if(bad)
+			fprintf(stderr, "%s(): \"%s\" is corrupted\n", __FUNCTION__, name);
+		if(!offset || bad)
+			return -1;
+
+		if((size_t)pos >= size)
+			return 0;
+		want = len == 0 || len > size - pos? size - pos : len;
+
+		if(codec) {
+			if(!(buf = malloc(want))) {
+				perror("malloc");
+				exit(EXIT_FAILURE);
+			}
+			n = o_entry_read(of, name, buf, pos, want);
+			n = n > 0? (ssize_t)o_send_data(out, buf, n) : -1;
+			free(buf);
+			return n;
+		}
+
+		/* Con el flock() compartido ningun escritor puede mover los datos.
+		 * Los escritores de este proceso se esperan con el mutex, un
+		 * flock() del mismo descriptor cambiaria el lock.
+		 */
+		locked = 0;
+		if(of->opts & O_OPT_SHARED) {
+			pthread_mutex_lock(&of->lock);
+			flock(of->fd, LOCK_SH);
+			locked = 1;
+			/* Ni la memoria mapeada cambia de direccion */
+			pthread_rwlock_rdlock(&of->mapped.lock);
+			if(*(volatile unsigned int *)&OHEADER(of)->gen != (unsigned int)gen) {
+				pthread_rwlock_unlock(&of->mapped.lock);
+				flock(of->fd, LOCK_UN);
+				pthread_mutex_unlock(&of->lock);
+				continue;
+			}
+		}
+		break;
+	} while(1);
+
+	from += pos;
+	for(sent = 0; sent < want; sent += n) {
+		n = sendfile(out, of->fd, &from, want - sent);
+		if(n < 0 && errno == EINTR)
+			n = 0;
+		else if(n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			/* 'out' no lo admite, se escribe desde la memoria mapeada */
+			if(!of->win.max)
+				sent += o_send_data(out, OADDR(of, from), want - sent);
+			else if((buf = o_win_get(of, from, want - sent))) {
+				sent += o_send_data(out, buf, want - sent);
+				o_win_put(of, buf);
+			}
+			break;
+		} else if(n <= 0)
+			break;
+	}
+
+	if(locked) {
+		pthread_rwlock_unlock(&of->mapped.lock);
+		flock(of->fd, LOCK_UN);
+		pthread_mutex_unlock(&of->lock);
+	}
+
+	return sent? (ssize_t)sent : -1;
+}
+
+/* o_entry_iovec(): Prepara 'iov' para writev(): la cabecera 'head' de
+ * 'headlen' bytes (si no es NULL) y luego los datos de la entrada, tal como
+ * estan en la memoria mapeada. Sirven hasta la siguiente modificacion, igual
+ * que o_access_to_mem(). Retorna los segmentos usados de 'iov' (a lo mas 2),
+ * 0 si la entrada no existe, esta comprimida o tiene errores, -1 con ventanas
+ * (errno ENOTSUP).
+ */
+int o_entry_iovec(o_file *of, const char *name, const void *head, size_t headlen, struct iovec *iov)
+{
+	off_t offset;
+	o_entry_view e;
+	long gen;
+	int n;
+
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	do {
+		if((gen = o_read_begin(of)) < 0)
+			return 0;
+
+		n = 0;
+		if(head) {
+			iov[n].iov_base = (void *)head;
+			iov[n++].iov_len = headlen;
+		}
+
+		if( (offset = o_lookup(of, name)) && o_entry_at(of, offset, &e) && o_md_good(of, offset, &e) &&
+		    !O_CODEC(&e.md) ) {
+			iov[n].iov_base = e.data;
+			iov[n++].iov_len = e.md.size;
+		} else
+			n = 0;
+	} while(o_read_retry(of, gen));
+
+	return n;
+}
+
+/* o_prefetch(): Pide al sistema (MADV_WILLNEED) las paginas de las entradas
+ * de 'names', que termina en NULL, asi las lecturas siguientes no esperan al
+ * disco. Retorna cuantas entradas se encontraron, -1 con ventanas (errno
+ * ENOTSUP).
+ */
+int o_prefetch(o_file *of, const char **names)
+{
+	off_t offset, start;
+	o_entry_view e;
+	size_t end;
+	long gen;
+	int i, n;
+
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	do {
+		if((gen = o_read_begin(of)) < 0)
+			return 0;
+
+		for(i = n = 0; names[i]; i++) {
+			if(!(offset = o_lookup(of, names[i])) || !o_entry_at(of, offset, &e))
+				continue;
+			start = offset - offset % of->pagsize;
+			end = offset + (e.data - e.head) + e.md.size;
+			madvise(OADDR(of, start), end - start, MADV_WILLNEED);
+			n++;
+		}
+	} while(o_read_retry(of, gen));
+
+	return n;
+}
+
+/* o_aio_init(): Prepara los pedidos asincronos, hasta 'depth' en curso. Los
+ * datos se leen y escriben con el descriptor del fichero (io_uring), no con
+ * la memoria mapeada: una entrada que no esta en memoria no detiene al hilo.
+ * Retorna 1 con io_uring, 0 si el sistema no lo tiene; en ese caso cada
+ * pedido se hace con pread()/pwrite() al enviarlo.
+ */
+int o_aio_init(o_file *of, unsigned int depth)
+{
+	int ret;
+
+	pthread_mutex_lock(&of->aio.mutex);
+	if(of->aio.ring.fd >= 0)
+		ocore_uring_free(&of->aio.ring);
+	ret = ocore_uring_init(&of->aio.ring, depth);
+	pthread_mutex_unlock(&of->aio.mutex);
+
+	return ret;
+}
+
+/* o_aio_fd(): Descriptor que queda listo para leer (poll(), epoll) cuando
+ * hay pedidos completados, -1 sin io_uring.
+ */
+int o_aio_fd(o_file *of)
+{
+	return of->aio.ring.fd;
+}
+
+/* o_aio_finish(): Termina un pedido con el resultado 'res' de la lectura o
+ * escritura. Una escritura completa hace visible la entrada.
+ */
+static void o_aio_finish(o_aio_req *r, int res)
+{
+	r->result = res;
+
+	if(r->op == O_AIO_READ) {
+		if(res >= 0 && r->check && ocore_crc32c(0, r->data, res) != r->crc) {
+			fprintf(stderr, "%s(): \"%s\" is corrupted\n", __FUNCTION__, r->name);
+			r->result = -EIO;
+		}
+		return;
+	}
+
+	if(res == (int)r->size) {
+		r->w->used = r->size;
+		r->w->crc = r->crc;
+		if(!o_entry_commit(r->w))
+			r->result = -EEXIST;
+	} else {
+		o_entry_abort(r->w);
+		if(res >= 0)
+			r->result = -EIO;
+	}
+	r->w = NULL;
+}
+
+/* o_aio_done(): Deja un pedido ya terminado para o_aio_wait() */
+static void o_aio_done(o_file *of, o_aio_req *r)
+{
+	r->next = NULL;
+	pthread_mutex_lock(&of->aio.mutex);
+	if(of->aio.done_tail)
+		of->aio.done_tail->next = r;
+	else
+		of->aio.done = r;
+	of->aio.done_tail = r;
+	pthread_mutex_unlock(&of->aio.mutex);
+}
+
+/* o_aio_reap(): Termina los pedidos que el sistema ya completo y los deja
+ * para o_aio_wait(). Se llama al enviar y al esperar: una escritura suelta
+ * su reserva y hace visible la entrada apenas sus datos estan escritos, no
+ * cuando se entrega. Con 'wait' espera uno si no hay ninguno completo.
+ * Retorna cuantos termino.
+ */
+static int o_aio_reap(o_file *of, int wait)
+{
+	o_aio_req *list = NULL, *r, *next;
+	void *data;
+	int res, n = 0;
+
+	pthread_mutex_lock(&of->aio.mutex);
+	if(of->aio.ring.queued)
+		ocore_uring_submit(&of->aio.ring, 0);
+	for(;;) {
+		if(ocore_uring_reap(&of->aio.ring, &data, &res)) {
+			r = data;
+			r->result = res;
+			r->next = list;
+			list = r;
+			n++;
+			continue;
+		}
+		if(n || !wait || of->aio.ring.inflight + of->aio.ring.queued == 0 ||
+		   ocore_uring_submit(&of->aio.ring, 1) < 0)
+			break;
+	}
+	pthread_mutex_unlock(&of->aio.mutex);
+
+	/* Terminar una escritura modifica el fichero, fuera del mutex de la
+	 * cola. 'list' quedo al reves.
+	 */
+	for(r = NULL; list; list = next) {
+		next = list->next;
+		list->next = r;
+		r = list;
+	}
+	for(; r; r = next) {
+		next = r->next;
+		o_aio_finish(r, r->result);
+		o_aio_done(of, r);
+	}
+
+	return n;
+}
+
+/* o_aio_start(): Envia la lectura o escritura de 'len' bytes en 'offset' del
+ * fichero. Retorna 0 si hay demasiados pedidos en curso.
+ */
+static int o_aio_start(o_file *of, o_aio_req *r, off_t offset, size_t len)
+{
+	ssize_t n;
+
+	pthread_mutex_lock(&of->aio.mutex);
+	if(of->aio.ring.fd >= 0) {
+		if(!ocore_uring_prep(&of->aio.ring, r->op == O_AIO_WRITE? OCORE_URING_WRITE : OCORE_URING_READ,
+		   of->fd, r->data, len, offset, r)) {
+			pthread_mutex_unlock(&of->aio.mutex);
+			r->result = -EAGAIN;
+			return 0;
+		}
+		ocore_uring_submit(&of->aio.ring, 0);
+		pthread_mutex_unlock(&of->aio.mutex);
+		o_aio_reap(of, 0);
+		return 1;
+	}
+	pthread_mutex_unlock(&of->aio.mutex);
+
+	n = r->op == O_AIO_WRITE? pwrite(of->fd, r->data, len, offset) : pread(of->fd, r->data, len, offset);
+	o_aio_finish(r, n < 0? -errno : n);
+	o_aio_done(of, r);
+
+	return 1;
+}
+
+/* o_read_entry_async(): Pide leer hasta r->size bytes de la entrada r->name
+ * en r->data. El nombre se busca al enviar; si otro escritor mueve la
+ * entrada antes de completarse, los datos pueden no ser los de ella (igual
+ * que con o_access_to_mem()). Las entradas comprimidas se leen en el acto.
+ * Retorna 1 si el pedido quedo enviado, 0 si no (r->result dice por que).
+ */
+int o_read_entry_async(o_file *of, o_aio_req *r)
+{
+	off_t offset, from = 0;
+	o_entry_view e;
+	size_t len = 0;
+	long gen;
+	int codec = 0;
+
+	r->op = O_AIO_READ;
+	r->result = 0;
+	r->w = NULL;
+
+	do {
+		if((gen = o_read_begin(of)) < 0) {
+			r->result = -EIO;
+			return 0;
+		}
+
+		/* Solo hace falta el metadata, los datos se leen del descriptor */
+		if( (offset = o_lookup(of, r->name)) && o_entry_head(of, offset, &e) ) {
+			codec = O_CODEC(&e.md);
+			from = offset + (e.data - e.head);
+			len = e.md.size < r->size? e.md.size : r->size;
+			/* El CRC32C solo se puede revisar con todos los datos */
+			r->check = len == e.md.size && !of->v1 && !o_verified_test(of, offset);
+			r->crc = e.md.crc;
+			o_entry_put(of, &e);
+		} else
+			offset = 0;
+	} while(o_read_retry(of, gen));
+
+	if(!offset) {
+		r->result = -ENOENT;
+		return 0;
+	}
+
+	if(codec) {
+		len = o_read_entry(of, r->name, r->data, r->size);
+		r->result = len? (ssize_t)len : -EIO;
+		o_aio_done(of, r);
+		return 1;
+	}
+
+	return o_aio_start(of, r, from, len);
+}
+
+/* o_write_entry_async(): Pide escribir la nueva entrada r->name con r->size
+ * bytes de r->data. El espacio se reserva al enviar (como
+ * o_entry_open_write()) y la entrada es visible cuando o_aio_wait() entrega
+ * el pedido. Los datos se guardan sin comprimir y deben seguir en r->data
+ * hasta entonces. Retorna 1 si el pedido quedo enviado.
+ */
+int o_write_entry_async(o_file *of, o_aio_req *r)
+{
+	r->op = O_AIO_WRITE;
+	r->result = 0;
+	r->check = 0;
+
+	if(r->size == 0 || !(r->w = o_entry_open_write(of, r->name, r->size))) {
+		r->result = r->size? -EEXIST : -EINVAL;
+		return 0;
+	}
+	r->crc = ocore_crc32c(0, r->data, r->size);
+
+	if(!o_aio_start(of, r, r->w->offset + sizeof(o_metadata) + strlen(r->name) + 1, r->size)) {
+		o_entry_abort(r->w);
+		r->w = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* o_aio_wait(): Entrega un pedido completado, esperando uno si 'wait' y hay
+ * pedidos en curso. Llama a su 'done'. Retorna NULL si no hay.
+ */
+o_aio_req *o_aio_wait(o_file *of, int wait)
+{
+	o_aio_req *r;
+	int pending;
+
+	for(;;) {
+		pthread_mutex_lock(&of->aio.mutex);
+		if((r = of->aio.done) && !(of->aio.done = r->next))
+			of->aio.done_tail = NULL;
+		pending = of->aio.ring.fd >= 0 && of->aio.ring.inflight + of->aio.ring.queued > 0;
+		pthread_mutex_unlock(&of->aio.mutex);
+
+		if(r || !pending || !o_aio_reap(of, wait))
+			break;
+	}
+
+	if(r && r->done)
+		r->done(r);
+
+	return r;
+}
+
+/* o_release_mem(): Termina de usar los datos de o_pin_mem(), con ventanas
+ * la suya puede volver a reemplazarse.
+ */
+void o_release_mem(o_file *of, void *addr)
+{
+	if(of->win.max && addr)
+		o_win_put(of, addr);
+}
+
+int o_touch_entry(o_file *of, const char *name)
+{
+	o_entry_view e;
+	off_t offset;
+	long gen;
+	int size;
+
+	do {
+		if((gen = o_read_begin(of)) < 0)
+			return 0;
+
+		size = 0;
+		if( (offset = o_lookup(of, name)) && o_entry_at(of, offset, &e) ) {
+			if(o_md_good(of, offset, &e))
+				size = o_data_size(&e);
+			o_entry_put(of, &e);
+		}
+	} while(o_read_retry(of, gen));
+
+	return size;
+}
+
+/* o_clean_up(): Elimina todas las entradas. No se recorre nada, la cabecera
+ * vuelve a cero, el fichero se recorta una vez al tamano de un indice vacio
+ * y la memoria mapeada se reduce una vez.
+ */
+void o_clean_up(o_file *of)
+{
+	o_file_header *header;
+	o_entry_writer *w;
+	size_t cap;
+
+	if(!(of->flags & O_RDWR))
+		return;
+
+	if(of) {
+		o_begin(of);
+		header = OHEADER(of);
+		header->f_size = O_HEADERSIZE;
+		header->num = 0;
+		header->dead = 0;
+		memset(header->free, 0, sizeof(header->free));
+		header->index = 0;
+		header->index_size = 0;
+		header->index_used = 0;
+		header->epoch++;
+		header->dict = 0;
+		header->dict_gen++;
+		o_verified_reset(of);
+		OHEADER(of)->compacting = 0;
+
+		/* El espacio de los escritores por partes tambien se elimina, los
+		 * de otros procesos lo notan en o_stream_valid().
+		 */
+		header->streams = 0;
+		for(w = of->writers; w; w = w->next)
+			w->offset = 0;
+		if(of->order.valid)
+			ocore_skiplist_destroy_all(&of->order.names);
+
+		/* Espacio justo para el indice vacio, o_index_resize() no necesita
+		 * crecer. En modo compartido el fichero no se achica.
+		 */
+		if(!(of->opts & O_OPT_SHARED)) {
+			cap = O_HEADERSIZE + O_DEAD_MIN + OFILE_HASHSIZE * sizeof(o_index_slot) + O_INDEX_ALIGN - 1;
+			cap = PAGES(of->pagsize, cap) * of->pagsize;
+			if(ftruncate(of->fd, cap) == -1)
+				perror("ftruncate");
+			o_mremap(of, cap / of->pagsize);
+			OFILE_CAPACITY(of) = cap;
+		}
+
+		o_index_resize(of, OFILE_HASHSIZE);
+		o_end(of);
+	}
+
+}
+
+/* o_list(): Recorre las entradas en el orden del indice. 'pos' debe
+ * comenzar en 0. Retorna el nombre de la siguiente entrada o NULL al final
+ * (con ventanas, errno ENOTSUP).
+ */
+const char *o_list(o_file *of, unsigned int *pos)
+{
+	o_index_slot *slots;
+	unsigned int size;
+
+	/* Los nombres estan en la memoria mapeada */
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	slots = o_index(of);
+	size = o_index_size(of);
+
+	while(*pos < size) {
+		if(slots[*pos].offset > O_INDEX_DELETED)
+			return (char *)OADDR(of, slots[(*pos)++].offset + O_MDSIZE(of));
+		(*pos)++;
+	}
+
+	return NULL;
+}
+
+/* o_foreach(): Recorre las entradas en el orden del fichero, desde
+ * la primera. Los accesos son secuenciales: se avisa MADV_SEQUENTIAL al
+ * comenzar y MADV_WILLNEED OFILE_FOREACH_AHEAD bytes por delante. Retorna
+ * el nombre de la siguiente entrada (su offset queda en c->entry) o NULL
+ * al final (con ventanas, errno ENOTSUP).
+ */
+const char *o_foreach(o_file *of, o_cursor *c)
+{
+	off_t end, start;
+	o_entry_view e;
+	size_t sz;
+	long gen;
+
+	/* Con ventanas las entradas no estan en la memoria mapeada */
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	/* Cada paso es una lectura, la memoria mapeada no cambia durante el */
+	gen = o_read_begin(of);
+	if(c->offset == 0) {
+		if(gen < 0)
+			return NULL;
+		c->offset = O_FIRST(of);
+		c->advised = 0;
+		madvise(of->mapped.base, OMAPPED(of), MADV_SEQUENTIAL);
+	}
+
+	end = OFILE_SIZE(of) < OMAPPED(of)? OFILE_SIZE(of) : OMAPPED(of);
+	while(c->offset + O_MDSIZE(of) <= end) {
+		if(c->offset + OFILE_FOREACH_AHEAD / 2 > c->advised && c->advised < end) {
+			start = c->advised > c->offset? c->advised : c->offset;
+			start -= start % of->pagsize;
+			c->advised = start + OFILE_FOREACH_AHEAD;
+			madvise(OADDR(of, start), (c->advised < end? c->advised : end) - start, MADV_WILLNEED);
+		}
+
+		if(!o_entry_head(of, c->offset, &e))
+			break;
+		sz = o_entry_len(&e);
+		if(e.md.size > end || sz > end - c->offset)
+			break;
+
+		c->entry = c->offset;
+		c->offset += sz;
+		if(!O_ISDEAD(&e.md) && !O_ISSYS(&e.md)) {
+			if(gen >= 0)
+				o_read_end(of);
+			return e.name;
+		}
+	}
+
+	madvise(of->mapped.base, OMAPPED(of), o_advice(of));
+	if(gen >= 0)
+		o_read_end(of);
+	c->entry = 0;
+	return NULL;
+}
+
+typedef struct {
+	o_file *of;
+	off_t *offsets;
+	size_t n;
+	int bad;
+} o_verify_job;
+
+static void *o_verify_thread(void *arg)
+{
+	o_verify_job *job = arg;
+	o_file *of = job->of;
+	o_entry_view e;
+	size_t i;
+
+	for(i = 0; i < job->n; i++) {
+		if(o_entry_at(of, job->offsets[i], &e) && o_md_good(of, job->offsets[i], &e))
+			continue;
+		if(o_entry_head(of, job->offsets[i], &e))
+			fprintf(stderr, "o_verify(): \"%s\" is corrupted\n", e.name);
+		else
+			fprintf(stderr, "o_verify(): entry at %lu is corrupted\n", (unsigned long)job->offsets[i]);
+		job->bad++;
+	}
+
+	return NULL;
+}
+
+/* o_verify(): Revisa el CRC32C de las entradas que aun no se revisan,
+ * repartidas entre 'threads' hilos. Los escritores del proceso esperan a
+ * que termine. Retorna el numero de entradas con errores, -1 con ventanas
+ * (errno ENOTSUP).
+ */
+int o_verify(o_file *of, int threads)
+{
+	o_cursor c = {0};
+	o_verify_job *jobs;
+	pthread_t *tid;
+	off_t *offsets = NULL;
+	size_t n = 0, max = 0, per;
+	int t, bad = 0;
+
+	if(threads < 1)
+		threads = 1;
+
+	if(of->win.max) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	pthread_mutex_lock(&of->lock);
+	while(o_foreach(of, &c)) {
+		if(o_verified_test(of, c.entry))
+			continue;
+		if(n == max) {
+			max = max? max * 2 : 1024;
+			if(!(offsets = realloc(offsets, max * sizeof(off_t)))) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		offsets[n++] = c.entry;
+	}
+
+	jobs = calloc(threads, sizeof(o_verify_job));
+	tid = calloc(threads, sizeof(pthread_t));
+	if(!jobs || !tid) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* El mapa crece antes, no mientras los hilos lo marcan.
+	 * El primer tramo lo revisa este hilo.
+	 */
+	if(n)
+		o_verified_map(of, offsets[n - 1]);
+	/* Otro lector del proceso no puede mover la memoria mapeada */
+	pthread_rwlock_rdlock(&of->mapped.lock);
+	per = (n + threads - 1) / threads;
+	for(t = 0; t < threads && t * per < n; t++) {
+		jobs[t].of = of;
+		jobs[t].offsets = offsets + t * per;
+		jobs[t].n = n - t * per < per? n - t * per : per;
+		if(t > 0 && pthread_create(&tid[t], NULL, o_verify_thread, &jobs[t]) != 0) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(n)
+		o_verify_thread(&jobs[0]);
+
+	while(--t > 0)
+		pthread_join(tid[t], NULL);
+	pthread_rwlock_unlock(&of->mapped.lock);
+	for(t = 0; t < threads; t++)
+		bad += jobs[t].bad;
+	pthread_mutex_unlock(&of->lock);
+
+	free(jobs);
+	free(tid);
+	free(offsets);
+
+	return bad;
+}
+
+/* o_set_dict(): Guarda en el fichero un diccionario de compresion de hasta
+ * OCORE_LZ_WINDOW bytes. Lo usan las entradas que se comprimen despues.
+ * Solo puede haber uno, hasta o_clean_up(). Retorna 1 si se guardo.
+ */
+int o_set_dict(o_file *of, const void *dict, size_t len)
+{
+	o_metadata md;
+	off_t offset;
+
+	if(!(of->flags & O_RDWR) || len == 0 || len > OCORE_LZ_WINDOW)
+		return 0;
+
+	o_begin(of);
+	md.namelen = O_MD_SYS;
+	md.size = len;
+	md.crc = md.reserved = 0;
+	if(OHEADER(of)->dict || !(offset = o_reserve(of, "", &md))) {
+		o_end(of);
+		return 0;
+	}
+	memcpy(OADDR(of, offset + sizeof(o_metadata) + O_NAMESIZE(&md)), dict, len);
+	OHEADER(of)->dict = offset;
+	OHEADER(of)->dict_gen++;
+
+	/* La copia propia, o_zdict() no se puede llamar con el lock */
+	pthread_mutex_lock(&of->zdict.mutex);
+	free(of->zdict.data);
+	if(!(of->zdict.data = malloc(len))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(of->zdict.data, dict, len);
+	of->zdict.size = len;
+	of->zdict.gen = OHEADER(of)->dict_gen;
+	pthread_mutex_unlock(&of->zdict.mutex);
+
+	o_end(of);
+	return 1;
+}
+
+/* o_train_dict(): Arma un diccionario de hasta 'size' bytes con los datos
+ * de las primeras entradas del fichero (a lo mas OFILE_DICT_SAMPLE bytes
+ * por byte de diccionario) y lo guarda con o_set_dict(). Retorna el tamano
+ * del diccionario, 0 si no se pudo.
+ */
+int o_train_dict(o_file *of, size_t size)
+{
+	o_cursor c = {0};
+	const void **samples = NULL;
+	size_t *sizes = NULL, total = 0, len = 0;
+	int n = 0, max = 0, i;
+	void *buf, *dict;
+	o_entry_view e;
+
+	if(!(of->flags & O_RDWR) || OHEADER(of)->dict || size == 0)
+		return 0;
+	if(size > OCORE_LZ_WINDOW)
+		size = OCORE_LZ_WINDOW;
+
+	while(total < size * OFILE_DICT_SAMPLE && o_foreach(of, &c)) {
+		if(!o_entry_at(of, c.entry, &e) || O_CODEC(&e.md) == O_CODEC_LZ_DICT || (len = o_data_size(&e)) == 0)
+			continue;
+
+		if(n == max) {
+			max = max? max * 2 : 64;
+			samples = realloc(samples, max * sizeof(void *));
+			sizes = realloc(sizes, max * sizeof(size_t));
+			if(!samples || !sizes) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if(!(buf = malloc(len))) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		if(o_md_read(of, &e, buf, 0, len) != len) {
+			free(buf);
+			continue;
+		}
+		samples[n] = buf;
+		sizes[n++] = len;
+		total += len;
+	}
+
+	if(!(dict = malloc(size))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	len = ocore_lz_train(samples, sizes, n, dict, size);
+	if(len && !o_set_dict(of, dict, len))
+		len = 0;
+
+	for(i = 0; i < n; i++)
+		free((void *)samples[i]);
+	free(samples);
+	free(sizes);
+	free(dict);
+
+	return len;
+}
+
+/* o_order_build(): Arma los nombres en orden recorriendo el indice. Solo
+ * lee los nombres, los datos no se tocan.
+ */
+static void o_order_build(o_file *of)
+{
+	o_index_slot *slots;
+	unsigned int size, i;
+	o_entry_view e;
+	long gen;
+
+	if(!of->order.names.head)
+		ocore_skiplist_init(&of->order.names);
+
+	do {
+		ocore_skiplist_destroy_all(&of->order.names);
+		/* Si el escritor murio, el indice del fichero no sirve */
+		if((gen = o_read_begin(of)) < 0 && !of->priv.slots)
+			o_priv_build(of);
+
+		/* Con ventanas los nombres no estan en la memoria mapeada */
+		if(of->win.max) {
+			if(gen >= 0)
+				o_read_end(of);
+			break;
+		}
+
+		slots = o_index(of);
+		size = o_index_size(of);
+		for(i = 0; i < size; i++) {
+			if(slots[i].offset <= O_INDEX_DELETED || !o_entry_head(of, slots[i].offset, &e))
+				continue;
+			/* El indice propio no se entera de las eliminaciones */
+			if(!O_ISDEAD(&e.md))
+				ocore_skiplist_add(&of->order.names, e.name, NULL);
+		}
+	} while(gen >= 0 && o_read_retry(of, gen));
+
+	of->order.gen = OHEADER(of)->gen;
+	of->order.valid = 1;
+}
+
+/* o_scan_start(): Deja el cursor en el primer nombre mayor o igual a 'from'.
+ * Los nombres en orden se arman aqui la primera vez, o si otro proceso
+ * modifico el fichero.
+ */
+static void o_scan_start(o_file *of, o_scan *sc, const char *from)
+{
+	/* Los nombres en orden apuntan a la memoria mapeada */
+	if(of->win.max) {
+		sc->node = NULL;
+		errno = ENOTSUP;
+		return;
+	}
+
+	pthread_mutex_lock(&of->lock);
+	if(!of->order.valid || of->order.gen != OHEADER(of)->gen)
+		o_order_build(of);
+	sc->node = ocore_skiplist_seek(&of->order.names, from);
+	pthread_mutex_unlock(&of->lock);
+}
+
+/* o_scan_prefix(): Recorre en orden los nombres que comienzan con 'prefix'
+ * (sin distinguir mayusculas). Solo se visitan las entradas que coinciden.
+ */
+void o_scan_prefix(o_file *of, o_scan *sc, const char *prefix)
+{
+	sc->prefix = prefix;
+	sc->len = strlen(prefix);
+	sc->to = NULL;
+	o_scan_start(of, sc, prefix);
+}
+
+/* o_scan_range(): Recorre en orden los nombres en [from, to). 'from' NULL
+ * comienza en el primero, 'to' NULL sigue hasta el ultimo.
+ */
+void o_scan_range(o_file *of, o_scan *sc, const char *from, const char *to)
+{
+	sc->prefix = NULL;
+	sc->len = 0;
+	sc->to = to;
+	o_scan_start(of, sc, from? from : "");
+}
+
+/* o_scan_next(): Retorna el siguiente nombre del recorrido o NULL al final.
+ */
+const char *o_scan_next(o_scan *sc)
+{
+	ocore_skiplist_node *node = sc->node;
+
+	if(!node)
+		return NULL;
+	if((sc->prefix && strncasecmp(node->name, sc->prefix, sc->len) != 0) ||
+	   (sc->to && strcasecmp(node->name, sc->to) >= 0)) {
+		sc->node = NULL;
+		return NULL;
+	}
+
+	sc->node = ocore_skiplist_next(node);
+	return node->name;
+}
+
+/* o_refresh(): Pone al dia un lector con lo que escribieron otros procesos.
+ * Agranda la memoria mapeada y, si el lector usa un indice propio, agrega
+ * solo las entradas escritas al final desde la ultima vez. Si las entradas
+ * se movieron (compactacion) lo reconstruye completo; las escritas en huecos
+ * reutilizados las toma de la cabecera (ver O_REUSE_LOG).
+ * Retorna 1 si el fichero cambio desde el ultimo o_refresh().
+ */
+int o_refresh(o_file *of)
+{
+	unsigned int gen;
+
+	if(o_read_begin(of) < 0)
+		return 0;
+	o_read_end(of);
+	o_map_update(of);
+
+	/* El indice propio cambia, sin lectores en otros hilos */
+	pthread_rwlock_wrlock(&of->mapped.lock);
+	if(of->priv.slots) {
+		if(OHEADER(of)->index && !OHEADER(of)->dirty) {
+			free(of->priv.slots);
+			of->priv.slots = NULL;
+		} else if(of->priv.epoch != OHEADER(of)->epoch ||
+		          OHEADER(of)->reused - of->priv.reused > O_REUSE_LOG)
+			o_priv_build(of);
+		else {
+			o_priv_reuse(of);
+			o_priv_scan(of);
+		}
+	}
+	gen = OHEADER(of)->gen;
+	pthread_rwlock_unlock(&of->mapped.lock);
+
+	/* El indice pudo moverse, o_end() lo hace solo en los escritores */
+	if(of->opts & O_OPT_MLOCK) {
+		pthread_mutex_lock(&of->lock);
+		pthread_rwlock_rdlock(&of->mapped.lock);
+		o_mlock_update(of);
+		pthread_rwlock_unlock(&of->mapped.lock);
+		pthread_mutex_unlock(&of->lock);
+	}
+
+	if(gen == of->gen)
+		return 0;
+
+	of->gen = gen;
+	return 1;
 }
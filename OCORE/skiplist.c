@@ -0,0 +1,206 @@
+/* Felipe Astroza 2006
+ * Ocore skiplist.c
+ * Under GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <skiplist.h>
+
+static ocore_skiplist_node *_ocore_skiplist_alloc_node(int level)
+{
+	ocore_skiplist_node *node;
+
+	node = calloc(1, sizeof(ocore_skiplist_node) + level * sizeof(ocore_skiplist_node *));
+	if(!node) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	node->level = level;
+
+	return node;
+}
+
+/* _ocore_skiplist_level(): Nivel aleatorio con p = 1/4 (xorshift propio,
+ * para no alterar rand() del programa).
+ */
+static int _ocore_skiplist_level(ocore_skiplist *list)
+{
+	unsigned int x = list->seed;
+	int level = 1;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	list->seed = x;
+
+	while((x & 3) == 0 && level < OCORE_SKIPLIST_MAX_LEVEL) {
+		level++;
+		x >>= 2;
+	}
+
+	return level;
+}
+
+/* ocore_skiplist_init(): Prepara una lista vacia.
+ */
+void ocore_skiplist_init(ocore_skiplist *list)
+{
+	if(list) {
+		memset(list, 0, sizeof(ocore_skiplist));
+		list->head = _ocore_skiplist_alloc_node(OCORE_SKIPLIST_MAX_LEVEL);
+		list->level = 1;
+		list->seed = 0x9e3779b9;
+	}
+}
+
+/* _ocore_skiplist_find(): Deja en 'update' el ultimo nodo menor que 'name'
+ * en cada nivel. Retorna el primer nodo mayor o igual.
+ */
+static ocore_skiplist_node *
+_ocore_skiplist_find(ocore_skiplist *list, const char *name, ocore_skiplist_node **update)
+{
+	ocore_skiplist_node *node = list->head;
+	int i;
+
+	for(i = list->level - 1; i >= 0; i--) {
+		while(node->next[i] && strcasecmp(node->next[i]->name, name) < 0)
+			node = node->next[i];
+		if(update)
+			update[i] = node;
+	}
+
+	return node->next[0];
+}
+
+/* ocore_skiplist_add(): Inserta 'name' en orden. Retorna NULL si ya existe.
+ */
+ocore_skiplist_node *
+ocore_skiplist_add(ocore_skiplist *list, const char *name, void *value)
+{
+	ocore_skiplist_node *update[OCORE_SKIPLIST_MAX_LEVEL], *node;
+	int i, level;
+
+	if(!list || !list->head || !name)
+		return NULL;
+
+	node = _ocore_skiplist_find(list, name, update);
+	if(node && strcasecmp(node->name, name) == 0)
+		return NULL;
+
+	level = _ocore_skiplist_level(list);
+	for(i = list->level; i < level; i++)
+		update[i] = list->head;
+	if(level > list->level)
+		list->level = level;
+
+	node = _ocore_skiplist_alloc_node(level);
+	node->name = strdup(name);
+	if(!node->name) {
+		perror("strdup");
+		exit(EXIT_FAILURE);
+	}
+	node->value = value;
+
+	for(i = 0; i < level; i++) {
+		node->next[i] = update[i]->next[i];
+		update[i]->next[i] = node;
+	}
+	list->count++;
+
+	return node;
+}
+
+/* ocore_skiplist_remove(): Elimina el nodo de 'name'.
+ */
+int ocore_skiplist_remove(ocore_skiplist *list, const char *name)
+{
+	ocore_skiplist_node *update[OCORE_SKIPLIST_MAX_LEVEL], *node;
+	int i;
+
+	if(!list || !list->head || !name)
+		return 0;
+
+	node = _ocore_skiplist_find(list, name, update);
+	if(!node || strcasecmp(node->name, name) != 0)
+		return 0;
+
+	for(i = 0; i < node->level; i++)
+		update[i]->next[i] = node->next[i];
+	while(list->level > 1 && !list->head->next[list->level - 1])
+		list->level--;
+
+	free(node->name);
+	free(node);
+	list->count--;
+	return 1;
+}
+
+/* ocore_skiplist_get_node(): Retorna el nodo de 'name' o NULL.
+ */
+ocore_skiplist_node *
+ocore_skiplist_get_node(ocore_skiplist *list, const char *name)
+{
+	ocore_skiplist_node *node;
+
+	if(!list || !list->head || !name)
+		return NULL;
+
+	node = _ocore_skiplist_find(list, name, NULL);
+	return node && strcasecmp(node->name, name) == 0? node : NULL;
+}
+
+/* ocore_skiplist_seek(): Retorna el primer nodo cuyo nombre es mayor o
+ * igual a 'name'. Desde ahi la lista se recorre con ocore_skiplist_next().
+ */
+ocore_skiplist_node *
+ocore_skiplist_seek(ocore_skiplist *list, const char *name)
+{
+	if(!list || !list->head || !name)
+		return NULL;
+
+	return _ocore_skiplist_find(list, name, NULL);
+}
+
+/* ocore_skiplist_count(): Retorna el numero de nodos
+ */
+unsigned int ocore_skiplist_count(ocore_skiplist *list)
+{
+	return list? list->count : 0;
+}
+
+/* ocore_skiplist_destroy_all(): Libera todos los nodos, la lista queda vacia.
+ */
+void ocore_skiplist_destroy_all(ocore_skiplist *list)
+{
+	ocore_skiplist_node *node, *next;
+	int i;
+
+	if(!list || !list->head)
+		return;
+
+	for(node = list->head->next[0]; node; node = next) {
+		next = node->next[0];
+		free(node->name);
+		free(node);
+	}
+
+	for(i = 0; i < OCORE_SKIPLIST_MAX_LEVEL; i++)
+		list->head->next[i] = NULL;
+	list->level = 1;
+	list->count = 0;
+}
+
+/* ocore_skiplist_free(): Libera los nodos y la cabecera.
+ */
+void ocore_skiplist_free(ocore_skiplist *list)
+{
+	if(list && list->head) {
+		ocore_skiplist_destroy_all(list);
+		free(list->head);
+		list->head = NULL;
+	}
+}
@@ -0,0 +1,189 @@
+/* Felipe Astroza 2006
+ * Ocore uring.c
+ * Under GPL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <uring.h>
+
+static int _uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _uring_enter(int fd, unsigned int submit, unsigned int wait, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+#define _URING_PTR(base, off) ((unsigned int *)((char *)(base) + (off)))
+
+/* ocore_uring_init(): Crea una cola de 'entries' pedidos. Retorna 0 si el
+ * sistema no tiene io_uring (o no lo permite), la cola queda con fd -1.
+ */
+int ocore_uring_init(ocore_uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(ring, 0, sizeof(ocore_uring));
+	memset(&p, 0, sizeof(p));
+
+	if((ring->fd = _uring_setup(entries, &p)) < 0) {
+		ring->fd = -1;
+		return 0;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	/* Con IORING_FEAT_SINGLE_MMAP ambos anillos van en el mismo mapeo */
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = 0;
+	}
+
+	ring->sq_ring = mmap(0, ring->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if(ring->cq_size) {
+		ring->cq_ring = mmap(0, ring->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto fail;
+		}
+	} else
+		ring->cq_ring = ring->sq_ring;
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(0, ring->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	ring->sq_head = _URING_PTR(ring->sq_ring, p.sq_off.head);
+	ring->sq_tail = _URING_PTR(ring->sq_ring, p.sq_off.tail);
+	ring->sq_mask = _URING_PTR(ring->sq_ring, p.sq_off.ring_mask);
+	ring->sq_array = _URING_PTR(ring->sq_ring, p.sq_off.array);
+
+	ring->cq_head = _URING_PTR(ring->cq_ring, p.cq_off.head);
+	ring->cq_tail = _URING_PTR(ring->cq_ring, p.cq_off.tail);
+	ring->cq_mask = _URING_PTR(ring->cq_ring, p.cq_off.ring_mask);
+	ring->cqes = (char *)ring->cq_ring + p.cq_off.cqes;
+
+	return 1;
+
+fail:
+	perror("mmap");
+	ocore_uring_free(ring);
+	return 0;
+}
+
+/* ocore_uring_prep(): Prepara una lectura o escritura de 'len' bytes en
+ * 'offset' de 'fd'. Se envia con ocore_uring_submit(). Retorna 0 si la cola
+ * esta llena.
+ */
+int ocore_uring_prep(ocore_uring *ring, int op, int fd, void *buf, size_t len, off_t offset, void *data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail, i;
+
+	if(ring->fd < 0 || ring->inflight + ring->queued >= ring->entries)
+		return 0;
+
+	tail = *ring->sq_tail;
+	i = tail & *ring->sq_mask;
+	sqe = (struct io_uring_sqe *)ring->sqes + i;
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = op == OCORE_URING_WRITE? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = (unsigned long)data;
+
+	ring->sq_array[i] = i;
+	/* El kernel lee el pedido despues de ver la nueva cola */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+
+	return 1;
+}
+
+/* ocore_uring_submit(): Envia los pedidos preparados y espera que se
+ * completen al menos 'wait'. Retorna los pedidos enviados o -1.
+ */
+int ocore_uring_submit(ocore_uring *ring, unsigned int wait)
+{
+	int n;
+
+	if(ring->fd < 0)
+		return -1;
+	if(wait > ring->inflight + ring->queued)
+		wait = ring->inflight + ring->queued;
+
+	do
+		n = _uring_enter(ring->fd, ring->queued, wait, wait? IORING_ENTER_GETEVENTS : 0);
+	while(n < 0 && errno == EINTR);
+	if(n < 0)
+		return -1;
+
+	ring->queued -= n;
+	ring->inflight += n;
+	return n;
+}
+
+/* ocore_uring_reap(): Saca un pedido completado, sin esperar. En 'res' queda
+ * el resultado (bytes, o -errno). Retorna 0 si no hay.
+ */
+int ocore_uring_reap(ocore_uring *ring, void **data, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+
+	if(ring->fd < 0)
+		return 0;
+
+	head = *ring->cq_head;
+	if(head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	cqe = (struct io_uring_cqe *)ring->cqes + (head & *ring->cq_mask);
+	*data = (void *)(unsigned long)cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	ring->inflight--;
+
+	return 1;
+}
+
+/* ocore_uring_free(): Cierra la cola. Los pedidos en curso se pierden.
+ */
+void ocore_uring_free(ocore_uring *ring)
+{
+	if(ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if(ring->cq_ring && ring->cq_ring != ring->sq_ring && ring->cq_ring != MAP_FAILED)
+		munmap(ring->cq_ring, ring->cq_size);
+	if(ring->sq_ring && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_size);
+	if(ring->fd >= 0)
+		close(ring->fd);
+
+	memset(ring, 0, sizeof(ocore_uring));
+	ring->fd = -1;
+}
@@ -0,0 +1,16 @@
+/* Felipe Astroza 2006
+ * Ocore crc32c.h
+ * Under LGPL
+ */
+#ifndef __OCORE_CRC32C_H_
+#define __OCORE_CRC32C_H_
+
+#include <stddef.h>
+
+/* CRC32C (Castagnoli). Usa la instruccion crc32 de SSE4.2 si el procesador
+ * la tiene, si no, tablas de a 8 bytes. 'crc' es el valor anterior (0 al
+ * comenzar), asi se puede calcular por partes.
+ */
+unsigned int ocore_crc32c(unsigned int crc, const void *buf, size_t len);
+
+#endif
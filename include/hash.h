@@ -5,21 +5,55 @@
 #ifndef __OCORE_HASH_H_
 #define __OCORE_HASH_H_
 
+/* 'hash' guarda el hash completo del nombre: solo se compara 'name' cuando
+ * los hash coinciden, y las redimensiones no vuelven a leer los nombres.
+ * 'list_prev' y 'list_next' enlazan todos los nodos en orden de insercion
+ * para ocore_hash_list(), las redimensiones no los tocan.
+ */
 typedef struct _ocore_hash_node {
 	char *name;
 	void *value;
 	int name_dup;
+	unsigned int hash;
 	struct _ocore_hash_node *next;
+	struct _ocore_hash_node *list_prev;
+	struct _ocore_hash_node *list_next;
 } ocore_hash_node;
 
 typedef void (*ocore_hash_free_func)(void *);
 
+/* La misma estructura sirve a los dos motores (ver OCORE/Makefile, HASH=):
+ * chain usa 'table' (buckets encadenados) y flat usa 'ctrl' + 'slots'
+ * (direccionamiento abierto, un byte de control por slot). En los dos los
+ * nodos se reservan aparte y no se mueven.
+ */
 typedef struct {
 	ocore_hash_node **table;
+	unsigned char *ctrl;
+	ocore_hash_node **slots;
 	unsigned int size;
+	unsigned int used; /* flat: slots con nodo o borrados */
+	unsigned int live; /* flat: slots con nodo */
+} ocore_hash_table;
+
+/* tab[0] es la tabla activa. Mientras se redimensiona, tab[1] es la tabla
+ * destino y cada operacion que modifica la hash traslada unos pocos buckets
+ * de tab[0] (desde rehash_idx) hacia tab[1]. 'first' y 'last' son los
+ * extremos de la lista de nodos en orden de insercion.
+ */
+typedef struct {
+	ocore_hash_table tab[2];
+	unsigned int count;
+	unsigned int min_size;
+	unsigned int rehash_idx;
+	ocore_hash_node *first;
+	ocore_hash_node *last;
 	ocore_hash_free_func free_func;
 } ocore_hash;
 
+/* Cursor de ocore_hash_list(), debe comenzar en ceros. 'node' es el ultimo
+ * nodo entregado, 'idx' distinto de 0 marca el final.
+ */
 typedef struct {
 	unsigned int idx;
 	ocore_hash_node *node;
@@ -27,6 +61,21 @@ typedef struct {
 
 #define DEFAULT_HASHSIZE 16
 
+/* Politica de redimension: crece al doble cuando hay mas de GROW_LOAD nodos
+ * por bucket, se reduce a la mitad cuando hay menos de un nodo cada
+ * SHRINK_LOAD buckets (nunca por debajo del tamano inicial).
+ */
+#define OCORE_HASH_GROW_LOAD	2
+#define OCORE_HASH_SHRINK_LOAD	8
+/* Buckets trasladados por cada operacion durante una redimension */
+#define OCORE_HASH_REHASH_STEP	4
+
+/* Motor flat: maxima carga (vivos + borrados) en octavos del tamano */
+#define OCORE_HASH_FLAT_MAX_LOAD	7
+#define OCORE_HASH_FLAT_GROUP		16
+
+#define OCORE_HASH_RESIZING(h) ((h)->tab[1].size != 0)
+
 void ocore_hash_init(ocore_hash *handle, unsigned int size, ocore_hash_free_func func);
 
 ocore_hash_node *ocore_hash_add(ocore_hash *handle, const char *name, void *value, int dup);
@@ -37,6 +86,7 @@ ocore_hash_node *ocore_hash_list(ocore_hash *handle, ocore_hash_position *pst);
 
 ocore_hash_node *ocore_hash_get_node(ocore_hash *handle, const char *name);
 void *ocore_hash_get_value(ocore_hash *handle, const char *name);
+unsigned int ocore_hash_count(ocore_hash *handle);
 
 void ocore_hash_destroy_all(ocore_hash *handle);
 void ocore_hash_free_table(ocore_hash *handle);
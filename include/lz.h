@@ -0,0 +1,30 @@
+/* Felipe Astroza 2006
+ * Ocore lz.h
+ * Under LGPL
+ */
+#ifndef __OCORE_LZ_H_
+#define __OCORE_LZ_H_
+
+#include <stddef.h>
+
+/* Compresor LZ77 rapido, con el formato de bloque de LZ4: cada secuencia es
+ * un token (4 bits de largo de literales, 4 bits de largo de coincidencia),
+ * los literales, un offset de 2 bytes y el resto de los largos en bytes de
+ * 255. La ultima secuencia solo tiene literales.
+ *
+ * El diccionario (opcional) hace de datos anteriores al bloque: las
+ * coincidencias pueden apuntar a sus ultimos OCORE_LZ_WINDOW bytes.
+ */
+#define OCORE_LZ_WINDOW		65535
+#define OCORE_LZ_MINMATCH	4
+
+/* Tamano maximo de 'n' bytes comprimidos */
+#define OCORE_LZ_BOUND(n)	((n) + (n) / 255 + 16)
+
+size_t ocore_lz_compress(const void *src, size_t n, void *dst, size_t cap,
+	const void *dict, size_t dictlen);
+size_t ocore_lz_decompress(const void *src, size_t n, void *dst, size_t cap,
+	const void *dict, size_t dictlen);
+size_t ocore_lz_train(const void **samples, const size_t *sizes, int n, void *dict, size_t cap);
+
+#endif
@@ -5,22 +5,120 @@
 #ifndef __O_FILE_
 #define __O_FILE_
 
+/* La libreria usa off_t de 64 bits. Con long de 32 bits off_t es de 32 si
+ * no se pide otro, y los programas verian otras funciones y estructuras.
+ */
+#if defined(__SIZEOF_LONG__) && __SIZEOF_LONG__ < 8 && (!defined(_FILE_OFFSET_BITS) || _FILE_OFFSET_BITS != 64)
+#error "ofile.h needs -D_FILE_OFFSET_BITS=64, like the library"
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <skiplist.h>
+#include <uring.h>
+
 #define OF_READ		'r'	
 #define OF_WRITE	'w'
 #define OF_TRUNCATE	't'
+#define OF_SHARED	's'
+#define OF_SYNC		'd'	/* cada modificacion va a disco antes de retornar */
+#define OF_GROUP	'g'	/* commit en grupo */
+#define OF_COMPRESS	'z'	/* comprime los datos de las entradas */
+#define OF_POPULATE	'p'	/* carga todo el fichero al abrir (MAP_POPULATE) */
+#define OF_HUGEPAGE	'h'	/* paginas grandes (MADV_HUGEPAGE) */
+#define OF_MLOCK	'l'	/* la cabecera y el indice no salen de memoria */
+#define OF_RANDOM	'a'	/* accesos aleatorios (MADV_RANDOM) */
+#define OF_SEQUENTIAL	'q'	/* accesos secuenciales (MADV_SEQUENTIAL) */
+#define OF_WINDOW	'v'	/* solo lectura, mapea por ventanas */
+
+/* Huecos libres por clase de tamano: la clase c tiene los huecos de
+ * 2^(c+6) bytes o menos (la ultima, todos los mayores).
+ */
+#define O_FREE_CLASSES	32
+
+/* Offsets de las ultimas entradas escritas antes del final del fichero
+ * (huecos reutilizados, renombres en su lugar) que guarda la cabecera.
+ * Un lector con indice propio que se atraso mas lo reconstruye.
+ */
+#define O_REUSE_LOG	16
+
+/* Version del formato. Los tamanos, offsets y contadores del fichero son
+ * de 64 bits, igual en cualquier arquitectura. La version 1 (el byte de
+ * version en 0) es el formato original, con la cabecera {fn, f_size, num}
+ * y la metadata {size, namelen} en tipos nativos; o_open() la convierte.
+ * Las versiones de desarrollo anteriores a la 2 tambien dejaban el byte en
+ * 0 con otra cabecera; esos ficheros no se abren (ver o_upgrade()).
+ */
+#define O_VERSION	2
 
 typedef struct {
 	char fn[3]; /* nombre del formato */
-	size_t f_size;
-	int num;
+	uint8_t version; /* O_VERSION */
+	uint32_t hsize; /* tamano de la cabecera, O_HEADERSIZE */
+	uint64_t f_size;
+	uint64_t num;
+	uint64_t capacity; /* bytes reservados en disco (y mapeados), >= f_size */
+	int64_t free[O_FREE_CLASSES]; /* primer hueco de cada clase, 0 = ninguno */
+	uint64_t dead; /* bytes ocupados por entradas eliminadas */
+	int64_t index; /* entrada con el indice de nombres, 0 = no hay */
+	uint32_t index_size; /* slots del indice, potencia de 2 */
+	uint32_t index_used; /* slots ocupados o borrados */
+	int32_t dirty; /* distinto de 0 durante una modificacion */
+	uint32_t gen; /* generacion, impar durante una modificacion (modo compartido) */
+	int32_t lock; /* pid del escritor con el lock, 0 = ninguno */
+	int32_t compacting;
+	int64_t compact_src; /* compactacion en curso: [dst, src) es espacio libre */
+	int64_t compact_dst;
+	uint32_t epoch; /* cambia cuando entradas ya escritas se mueven */
+	uint32_t dict_gen; /* cambia con cada diccionario */
+	int64_t dict; /* entrada con el diccionario de compresion, 0 = no hay */
+	int32_t streams; /* escritores por partes abiertos, la compactacion espera */
+	uint32_t reused; /* entradas escritas antes del final, la ultima en reuse[(reused - 1) % O_REUSE_LOG] */
+	int64_t reuse[O_REUSE_LOG];
 } o_file_header;
 
+/* Slots iniciales del indice */
 #define OFILE_HASHSIZE 32
+/* El indice crece antes de que los slots usados pasen de 1/OFILE_INDEX_LOAD */
+#define OFILE_INDEX_LOAD	2
+
+/* Al crecer, el espacio reservado aumenta en 1/OFILE_GROW_DIV de lo que tiene */
+#define OFILE_GROW_DIV	2
+
+/* Una entrada que se mueve al actualizarla queda con 1/OFILE_UPDATE_SLACK
+ * de holgura para crecer en el mismo lugar.
+ */
+#define OFILE_UPDATE_SLACK	4
 
 #define O_HEADERSIZE	sizeof(o_file_header)
 
+/* El bit alto de namelen marca una entrada eliminada, su espacio queda
+ * libre hasta la siguiente compactacion.
+ */
+#define O_MD_DEAD	((uint64_t)1 << 63)
+/* Entrada eliminada que ademas esta enlazada en una lista de huecos */
+#define O_MD_FREE	((uint64_t)1 << 62)
+/* Entrada interna de ofile (el indice, el diccionario, el espacio de un
+ * o_entry_writer), no es visible por nombre
+ */
+#define O_MD_SYS	((uint64_t)1 << 61)
+/* Codec de los datos. Una entrada comprimida guarda el tamano original
+ * (uint64_t) al comienzo de los datos, seguido de los datos comprimidos.
+ */
+#define O_MD_CODEC_SHIFT	59
+#define O_MD_CODEC	((uint64_t)3 << O_MD_CODEC_SHIFT)
+#define O_CODEC_NONE	0
+#define O_CODEC_LZ	1	/* ocore_lz */
+#define O_CODEC_LZ_DICT	2	/* ocore_lz con el diccionario del fichero */
+#define O_ISDEAD(a)	((a)->namelen & O_MD_DEAD)
+#define O_ISFREE(a)	((a)->namelen & O_MD_FREE)
+#define O_ISSYS(a)	((a)->namelen & O_MD_SYS)
+#define O_CODEC(a)	(((a)->namelen & O_MD_CODEC) >> O_MD_CODEC_SHIFT)
+#define O_NAMELEN(a)	((a)->namelen & ~(O_MD_DEAD|O_MD_FREE|O_MD_SYS|O_MD_CODEC))
+
 /* + 1 por el ultimo byte agregado cuyo valor es 0 */ 
-#define O_NAMESIZE(a) ((a)->namelen + 1)
+#define O_NAMESIZE(a) (O_NAMELEN(a) + 1)
 
 /* con entry_inf, consigue la cantidad de bytes que ocupa la entrada
  * en el fichero
@@ -34,10 +132,49 @@ typedef struct {
  * y la longitud del nombre 
  */
 typedef struct {
-	size_t size;
-	size_t namelen;
+	uint64_t size;
+	uint64_t namelen;
+	uint32_t crc; /* CRC32C de los datos guardados */
+	uint32_t reserved;
 } o_metadata;
 
+/* Slot del indice: hash del nombre (sin distinguir mayusculas), largo del
+ * nombre y offset de la entrada. Se buscan con sondeo lineal. Solo guarda
+ * offsets, no depende de donde este mapeado el fichero.
+ */
+typedef struct {
+	uint32_t hash;
+	uint32_t namelen;
+	int64_t offset;
+} o_index_slot;
+
+#define O_INDEX_EMPTY	0
+#define O_INDEX_DELETED	1
+
+/* Un bit por cada O_VERIFY_GRAIN bytes del fichero, ninguna entrada mide
+ * menos. Al crecer se reemplaza entero y el anterior queda en 'old' hasta
+ * o_close(), algun lector puede estar usandolo.
+ */
+#define O_VERIFY_GRAIN	16
+
+typedef struct _o_verified {
+	struct _o_verified *old;
+	size_t bits;
+	unsigned long map[];
+} o_verified;
+
+/* Ventana de OF_WINDOW: [start, start + len) del fichero en 'addr'. Con
+ * 'pins' > 0 alguien la esta usando y no se reemplaza; 'used' ordena el
+ * reemplazo (la menos usada).
+ */
+typedef struct {
+	void *addr;
+	off_t start;
+	size_t len;
+	int pins;
+	unsigned long used;
+} o_window;
+
 typedef struct {
 	int fd;
 	int flags;
@@ -46,23 +183,308 @@ typedef struct {
 	struct 
 	{
 		void *base;
-		int pages;
+		size_t pages;
 		int prot;
+		pthread_rwlock_t lock; /* la direccion no cambia mientras se lee (ver o_mremap()) */
 	} mapped;
 
-	ocore_hash hash;
+	/* Indice en memoria propia, cuando el del fichero no sirve y
+	 * no se puede reescribir (modo lectura)
+	 */
+	struct
+	{
+		o_index_slot *slots;
+		unsigned int size;
+		unsigned int used;
+		off_t indexed; /* hasta donde se recorrio el fichero */
+		unsigned int epoch; /* epoch de la cabecera al construirlo */
+		unsigned int reused; /* reused de la cabecera ya revisado */
+	} priv;
+
+	/* Fichero del formato 1 abierto para leer: se lee tal cual con el
+	 * indice propio, y esta cabecera lo describe (NULL si no)
+	 */
+	o_file_header *v1;
+
+	/* Generacion vista en el ultimo o_refresh() */
+	unsigned int gen;
+
+	/* Escritores del mismo proceso */
+	pthread_mutex_t lock;
+
+	/* Durabilidad: 'seq' cuenta las modificaciones terminadas, 'synced' la
+	 * ultima que esta en disco.
+	 */
+	struct
+	{
+		pthread_mutex_t mutex;
+		pthread_cond_t done; /* avisa a los que esperan un ticket */
+		pthread_cond_t kick; /* despierta al hilo del commit en grupo */
+		pthread_t thread;
+		int running;
+		unsigned long seq;
+		unsigned long synced;
+	} commit;
+
+	/* Opciones de o_open() que no son flags de open() */
+	int opts;
+
+	/* Entradas con el CRC32C revisado. En modo compartido 'gen' es la
+	 * generacion con que se revisaron, si otro proceso escribe se olvidan.
+	 */
+	struct
+	{
+		struct _o_verified *map;
+		unsigned int gen;
+		pthread_mutex_t mutex; /* al agrandar 'map' */
+	} verify;
+
+	/* Copia propia del diccionario de compresion, 'gen' es el dict_gen
+	 * de la cabecera cuando se copio.
+	 */
+	struct
+	{
+		void *data;
+		size_t size;
+		unsigned int gen;
+		pthread_mutex_t mutex; /* no el de los escritores, se usa dentro de las lecturas */
+	} zdict;
+
+	/* Nombres en orden para o_scan_prefix() y o_scan_range(). Se arma en
+	 * el primer recorrido y las modificaciones de este proceso lo mantienen;
+	 * si otro escribio (la generacion no es 'gen') se vuelve a armar.
+	 */
+	struct
+	{
+		ocore_skiplist names;
+		unsigned int gen;
+		int valid;
+	} order;
+
+	/* Paginas del indice con mlock() (OF_MLOCK), como offset: mremap()
+	 * las mueve bloqueadas.
+	 */
+	struct
+	{
+		off_t offset;
+		size_t len;
+	} mlocked;
+
+	/* Pedidos asincronos (o_aio_init()). Sin io_uring se completan al
+	 * enviarlos y esperan en 'done' a o_aio_wait().
+	 */
+	struct
+	{
+		ocore_uring ring;
+		pthread_mutex_t mutex;
+		struct _o_aio_req *done;
+		struct _o_aio_req *done_tail;
+	} aio;
+
+	/* Ventanas (OF_WINDOW). Solo la cabecera queda mapeada, las entradas
+	 * y el indice se leen a traves de 'w'. 'max' es 0 sin ventanas.
+	 */
+	struct
+	{
+		o_window *w;
+		int max;
+		int n;
+		unsigned long clock;
+		size_t fsize;
+		pthread_mutex_t mutex;
+	} win;
+
+	/* Escritores por partes abiertos por este proceso, o_clean_up() los
+	 * invalida.
+	 */
+	struct _o_entry_writer *writers;
 
 } o_file;
 
+/* Modo compartido: varios procesos con el mismo fichero abierto. Los
+ * escritores se turnan con flock(), los lectores leen con seqlock sobre la
+ * generacion de la cabecera y se ponen al dia solos.
+ */
+#define O_OPT_SHARED	0x01
+
+/* Vueltas de un lector esperando a un escritor antes de revisar si murio */
+#define O_SPIN_CHECK	64
+
+/* Durabilidad, sin 'd' ni 'g' queda a cargo del sistema (o de o_sync()) */
+#define O_OPT_SYNC	0x02
+#define O_OPT_GROUP	0x04
+
+/* Compresion (OF_COMPRESS): los datos de menos de OFILE_Z_MIN bytes, o que
+ * no se achican, se guardan tal cual.
+ */
+#define O_OPT_COMPRESS	0x08
+#define OFILE_Z_MIN	64
+/* o_train_dict() revisa hasta OFILE_DICT_SAMPLE bytes por byte de diccionario */
+#define OFILE_DICT_SAMPLE	100
+
+/* Memoria mapeada: OF_POPULATE, OF_HUGEPAGE, OF_MLOCK, OF_RANDOM y
+ * OF_SEQUENTIAL. Se aplican al abrir y a lo que se mapea al crecer.
+ */
+#define O_OPT_POPULATE	0x10
+#define O_OPT_HUGEPAGE	0x20
+#define O_OPT_MLOCK	0x40
+#define O_OPT_RANDOM	0x80
+#define O_OPT_SEQUENTIAL	0x100
+
+/* Ventanas (OF_WINDOW): para ficheros mayores que la memoria que se puede
+ * mapear. Se mapean a lo mas OFILE_WINDOWS ventanas de OFILE_WINDOW bytes
+ * (una entrada mayor tiene la suya, de su tamano).
+ */
+#define O_OPT_WINDOW	0x200
+#define OFILE_WINDOW	(1024 * 1024)
+#define OFILE_WINDOWS	8
+
+/* Intervalo maximo entre commits del grupo */
+#define OFILE_COMMIT_USEC	2000
+
+/* La compactacion comienza sola cuando los bytes eliminados superan
+ * OFILE_COMPACT_RATIO % del fichero. Luego cada escritura o eliminacion
+ * avanza a lo mas OFILE_COMPACT_STEP bytes.
+ */
+#define OFILE_COMPACT_RATIO	50
+#define OFILE_COMPACT_STEP	(256 * 1024)
+
+/* Entrada de o_write_batch(), 'offset' es de salida */
+typedef struct {
+	const char *name;
+	void *data;
+	size_t size;
+	off_t offset;
+} o_batch_entry;
+
+/* Entrada de o_read_entries(). 'data' es el buffer de 'size' bytes, o NULL
+ * para recibir en 'view' los datos en la memoria mapeada. 'len' (bytes
+ * leidos) y 'offset' (de la entrada, 0 si no se leyo) son de salida.
+ */
+typedef struct {
+	const char *name;
+	void *data;
+	size_t size;
+	const void *view;
+	size_t len;
+	off_t offset;
+} o_read_batch;
+
+/* o_read_entries() une en un solo MADV_WILLNEED las entradas que estan a
+ * menos de OFILE_MULTI_GAP bytes
+ */
+#define OFILE_MULTI_GAP	(64 * 1024)
+
+/* Cursor de o_scan_prefix() y o_scan_range(). Los nombres que entrega
+ * o_scan_next() sirven hasta la siguiente modificacion del fichero.
+ */
+typedef struct {
+	ocore_skiplist_node *node;
+	const char *prefix;
+	size_t len;
+	const char *to;
+} o_scan;
+
+/* Cursor de o_foreach(), debe comenzar en ceros. 'entry' es el offset de
+ * la entrada que retorno el ultimo paso.
+ */
+typedef struct {
+	off_t offset;
+	off_t entry;
+	off_t advised; /* hasta donde se pidio MADV_WILLNEED */
+} o_cursor;
+
+/* Bytes por delante de o_foreach() que se piden al sistema */
+#define OFILE_FOREACH_AHEAD	(1024 * 1024)
+
+/* Escritura de una entrada por partes (o_entry_open_write()). Los datos se
+ * copian a un espacio reservado en el fichero, que no es visible por nombre
+ * hasta o_entry_commit(). 'size' es lo reservado y 'used' lo escrito.
+ */
+typedef struct _o_entry_writer {
+	o_file *of;
+	char *name;
+	off_t offset; /* 0 si el espacio se perdio (o_clean_up()) */
+	size_t size;
+	size_t used;
+	unsigned int crc;
+	struct _o_entry_writer *next;
+} o_entry_writer;
+
+/* Espacio que se reserva si no se sabe el tamano de la entrada */
+#define OFILE_STREAM_CHUNK	(64 * 1024)
+
+/* Pedido de o_read_entry_async() u o_write_entry_async(). Debe seguir
+ * existiendo hasta que o_aio_wait() lo entregue. 'result' queda con los
+ * bytes leidos o escritos, o -errno; 'done' (si no es NULL) se llama desde
+ * o_aio_wait() al completarse.
+ *
+ * Una escritura en curso tiene su espacio reservado como un escritor por
+ * partes (o_entry_open_write()): la compactacion espera hasta que los datos
+ * estan escritos y la entrada se hace visible, en el siguiente envio u
+ * o_aio_wait(). Las lecturas de entradas comprimidas no son asincronas, se
+ * leen y descomprimen dentro de o_read_entry_async().
+ */
+typedef struct _o_aio_req {
+	const char *name;
+	void *data;
+	size_t size;
+	ssize_t result;
+	void (*done)(struct _o_aio_req *);
+	void *arg;
+
+	/* Uso interno */
+	int op;
+	int check; /* se revisa el CRC32C al completar */
+	unsigned int crc;
+	o_entry_writer *w;
+	struct _o_aio_req *next;
+} o_aio_req;
+
+#define O_AIO_READ	0
+#define O_AIO_WRITE	1
+
 o_file *o_open(const char *, const char *);
 int o_close(o_file *);
 int o_write_entry(o_file *, const char *, void *, size_t);
+int o_write_batch(o_file *, o_batch_entry *, int);
+int o_update_entry(o_file *, const char *, void *, size_t);
 int o_read_entry(o_file *, const char *, void *, size_t);
+int o_entry_read(o_file *, const char *, void *, size_t, size_t);
+int o_read_entries(o_file *, o_read_batch *, int);
+o_entry_writer *o_entry_open_write(o_file *, const char *, size_t);
+int o_entry_append(o_entry_writer *, const void *, size_t);
+int o_entry_commit(o_entry_writer *);
+void o_entry_abort(o_entry_writer *);
 int o_delete_entry(o_file *, const char *);
 int o_rename_entry(o_file *, const char *, const char *);
 off_t o_get_offset(o_file *, const char *);
 void *o_access_to_mem(o_file *, off_t, size_t *);
+void *o_pin_mem(o_file *, off_t, size_t *);
+void o_release_mem(o_file *, void *);
 int o_touch_entry(o_file *, const char *);
+int o_prefetch(o_file *, const char **);
+int o_aio_init(o_file *, unsigned int);
+int o_aio_fd(o_file *);
+int o_read_entry_async(o_file *, o_aio_req *);
+int o_write_entry_async(o_file *, o_aio_req *);
+o_aio_req *o_aio_wait(o_file *, int);
+ssize_t o_send_entry(o_file *, const char *, int, off_t, size_t);
+int o_entry_iovec(o_file *, const char *, const void *, size_t, struct iovec *);
 void o_clean_up(o_file *);
+int o_compact(o_file *, size_t);
+int o_compact_progress(o_file *);
+int o_verify(o_file *, int);
+int o_set_dict(o_file *, const void *, size_t);
+int o_train_dict(o_file *, size_t);
+const char *o_list(o_file *, unsigned int *);
+const char *o_foreach(o_file *, o_cursor *);
+void o_scan_prefix(o_file *, o_scan *, const char *);
+void o_scan_range(o_file *, o_scan *, const char *, const char *);
+const char *o_scan_next(o_scan *);
+int o_refresh(o_file *);
+void o_sync(o_file *);
+unsigned long o_commit_ticket(o_file *);
+void o_commit_wait(o_file *, unsigned long);
 
 #endif
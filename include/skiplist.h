@@ -0,0 +1,43 @@
+/* Felipe Astroza 2006
+ * Ocore skiplist.h
+ * Under LGPL
+ */
+#ifndef __OCORE_SKIPLIST_H_
+#define __OCORE_SKIPLIST_H_
+
+/* Lista de saltos ordenada por nombre (sin distinguir mayusculas, igual que
+ * ocore_hash). Cada nodo guarda una copia del nombre; 'next' tiene 'level'
+ * punteros, next[0] es la lista completa en orden.
+ */
+typedef struct _ocore_skiplist_node {
+	char *name;
+	void *value;
+	int level;
+	struct _ocore_skiplist_node *next[];
+} ocore_skiplist_node;
+
+#define OCORE_SKIPLIST_MAX_LEVEL	24
+
+typedef struct {
+	ocore_skiplist_node *head;
+	unsigned int count;
+	int level;
+	unsigned int seed;
+} ocore_skiplist;
+
+#define ocore_skiplist_first(s) ((s)->head? (s)->head->next[0] : NULL)
+#define ocore_skiplist_next(n) ((n)->next[0])
+
+void ocore_skiplist_init(ocore_skiplist *list);
+
+ocore_skiplist_node *ocore_skiplist_add(ocore_skiplist *list, const char *name, void *value);
+int ocore_skiplist_remove(ocore_skiplist *list, const char *name);
+
+ocore_skiplist_node *ocore_skiplist_get_node(ocore_skiplist *list, const char *name);
+ocore_skiplist_node *ocore_skiplist_seek(ocore_skiplist *list, const char *name);
+unsigned int ocore_skiplist_count(ocore_skiplist *list);
+
+void ocore_skiplist_destroy_all(ocore_skiplist *list);
+void ocore_skiplist_free(ocore_skiplist *list);
+
+#endif
@@ -0,0 +1,47 @@
+/* Felipe Astroza 2006
+ * Ocore uring.h
+ * Under LGPL
+ */
+#ifndef __OCORE_URING_H_
+#define __OCORE_URING_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Cola de lecturas y escrituras asincronas con io_uring de Linux, usando
+ * las llamadas al sistema directamente. Cada pedido lleva un puntero
+ * 'data' que se entrega al completarse.
+ */
+typedef struct {
+	int fd; /* -1 = sin io_uring */
+	unsigned int entries;
+	unsigned int inflight; /* pedidos enviados sin completar */
+	unsigned int queued; /* pedidos preparados sin enviar */
+
+	void *sq_ring;
+	size_t sq_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	void *sqes;
+	size_t sqes_size;
+
+	void *cq_ring;
+	size_t cq_size;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	void *cqes;
+} ocore_uring;
+
+#define OCORE_URING_READ	0
+#define OCORE_URING_WRITE	1
+
+int ocore_uring_init(ocore_uring *ring, unsigned int entries);
+int ocore_uring_prep(ocore_uring *ring, int op, int fd, void *buf, size_t len, off_t offset, void *data);
+int ocore_uring_submit(ocore_uring *ring, unsigned int wait);
+int ocore_uring_reap(ocore_uring *ring, void **data, int *res);
+void ocore_uring_free(ocore_uring *ring);
+
+#endif
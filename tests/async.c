@@ -0,0 +1,116 @@
+/* async.c: Escrituras y lecturas asincronas, con mas pedidos que los que
+ * pueden estar en curso. Sin io_uring se hacen al enviarlas, la prueba es
+ * la misma.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ofile.h>
+
+#define FILE_NAME	"async.ofl"
+#define REQUESTS	1000
+#define SIZE	1200
+
+static o_aio_req req[REQUESTS];
+static char names[REQUESTS][16];
+static char bufs[REQUESTS][SIZE];
+static int called;
+
+static void done(o_aio_req *r)
+{
+	called++;
+}
+
+static size_t entry_size(int i)
+{
+	return 100 + i % 1000;
+}
+
+/* Envia 'r', esperando otro pedido mientras no haya lugar */
+static int submit(o_file *of, o_aio_req *r, int (*send)(o_file *, o_aio_req *))
+{
+	while(!send(of, r))
+		if(r->result != -EAGAIN || !o_aio_wait(of, 1))
+			return 0;
+
+	return 1;
+}
+
+int main(void)
+{
+	o_file *of;
+	char buf[SIZE];
+	size_t len;
+	int i;
+
+	unlink(FILE_NAME);
+	if(!(of = o_open(FILE_NAME, "w")))
+		return 1;
+	o_aio_init(of, 32);
+
+	for(i = 0; i < REQUESTS; i++) {
+		sprintf(names[i], "entry%d", i);
+		memset(bufs[i], i, SIZE);
+		req[i].name = names[i];
+		req[i].data = bufs[i];
+		req[i].size = entry_size(i);
+		req[i].done = done;
+		if(!submit(of, &req[i], o_write_entry_async)) {
+			printf("async: write %d: %ld\n", i, (long)req[i].result);
+			return 1;
+		}
+	}
+	while(o_aio_wait(of, 1))
+		;
+	for(i = 0; i < REQUESTS; i++)
+		if(req[i].result != entry_size(i) || o_read_entry(of, names[i], buf, SIZE) != entry_size(i) ||
+		   buf[0] != (char)i) {
+			printf("async: bad write %d\n", i);
+			return 1;
+		}
+	if(o_write_entry_async(of, &req[0]) || req[0].result != -EEXIST) {
+		printf("async: duplicate write\n");
+		return 1;
+	}
+
+	/* Algunas lecturas son de una parte de la entrada */
+	for(i = 0; i < REQUESTS; i++) {
+		memset(bufs[i], 0, SIZE);
+		req[i].size = i % 7? SIZE : 50;
+		if(!submit(of, &req[i], o_read_entry_async)) {
+			printf("async: read %d: %ld\n", i, (long)req[i].result);
+			return 1;
+		}
+	}
+	while(o_aio_wait(of, 1))
+		;
+	for(i = 0; i < REQUESTS; i++) {
+		len = entry_size(i) < req[i].size? entry_size(i) : req[i].size;
+		if(req[i].result != len || bufs[i][len - 1] != (char)i) {
+			printf("async: bad read %d\n", i);
+			return 1;
+		}
+	}
+	req[0].name = "missing";
+	if(o_read_entry_async(of, &req[0]) || req[0].result != -ENOENT) {
+		printf("async: read of a missing entry\n");
+		return 1;
+	}
+	if(called != 2 * REQUESTS) {
+		printf("async: %d callbacks for %d requests\n", called, 2 * REQUESTS);
+		return 1;
+	}
+	o_close(of);
+
+	of = o_open(FILE_NAME, "r");
+	if(o_verify(of, 2) != 0 || o_read_entry(of, names[REQUESTS - 1], buf, SIZE) != entry_size(REQUESTS - 1)) {
+		printf("async: bad entries after reopen\n");
+		return 1;
+	}
+	o_close(of);
+
+	printf("async: ok\n");
+	unlink(FILE_NAME);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/* compact.c: Elimina la mayor parte de las entradas, compacta por partes
+ * mientras se escribe, y revisa el contenido antes y despues de volver a
+ * abrir el fichero.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <hash.h>
+#include <ofile.h>
+
+#define FILE_NAME	"compact.ofl"
+#define ENTRIES	3000
+
+/* Las entradas multiplo de 3 quedan vivas, 'late' son las escritas durante
+ * la compactacion
+ */
+static int alive(int i, int late)
+{
+	return late || i % 3 == 0;
+}
+
+/* El valor de cada entrada, de largo distinto segun 'i' */
+static int value(char *buf, int i, int late)
+{
+	return sprintf(buf, "%s-value-%d-%0*d", late? "late" : "entry", i, i % 200, 0);
+}
+
+static int check(o_file *of, const char *when)
+{
+	char name[32], buf[512], exp[512];
+	int i, late, n, len;
+
+	for(late = 0; late < 2; late++)
+		for(i = 0; i < ENTRIES; i++) {
+			sprintf(name, "%s%d", late? "late" : "entry", i);
+			if(late && i % 10 != 0)
+				continue;
+			len = value(exp, i, late);
+			n = o_touch_entry(of, name);
+			if(!alive(i, late)) {
+				if(n != 0) {
+					printf("compact: %s: deleted \"%s\" still there\n", when, name);
+					return 0;
+				}
+			} else if(n != len || o_read_entry(of, name, buf, len) != len || memcmp(buf, exp, len) != 0) {
+				printf("compact: %s: bad \"%s\"\n", when, name);
+				return 0;
+			}
+		}
+
+	return 1;
+}
+
+int main(void)
+{
+	o_file *of;
+	struct stat before, after;
+	char name[32], buf[512];
+	int i, len, more;
+
+	unlink(FILE_NAME);
+	if(!(of = o_open(FILE_NAME, "w")))
+		return 1;
+	for(i = 0; i < ENTRIES; i++) {
+		sprintf(name, "entry%d", i);
+		len = value(buf, i, 0);
+		o_write_entry(of, name, buf, len);
+	}
+	o_close(of);
+	stat(FILE_NAME, &before);
+
+	of = o_open(FILE_NAME, "w");
+	for(i = 0; i < ENTRIES; i++)
+		if(!alive(i, 0)) {
+			sprintf(name, "entry%d", i);
+			o_delete_entry(of, name);
+		}
+
+	/* Pasos cortos, con una escritura despues de cada uno */
+	for(i = 0, more = 1; i < ENTRIES; i += 10) {
+		if(more)
+			more = o_compact(of, 4096);
+		sprintf(name, "late%d", i);
+		len = value(buf, i, 1);
+		o_write_entry(of, name, buf, len);
+	}
+	while(o_compact(of, 4096))
+		;
+	if(o_compact_progress(of) != -1 || !check(of, "after compact"))
+		return 1;
+	o_close(of);
+
+	stat(FILE_NAME, &after);
+	if(after.st_size >= before.st_size) {
+		printf("compact: file did not shrink (%ld -> %ld)\n", (long)before.st_size, (long)after.st_size);
+		return 1;
+	}
+
+	of = o_open(FILE_NAME, "r");
+	if(!check(of, "reopen"))
+		return 1;
+	o_close(of);
+
+	printf("compact: ok\n");
+	unlink(FILE_NAME);
+	return 0;
+}
@@ -0,0 +1,80 @@
+/* crc.c: Cambia un byte de los datos de dos entradas en el fichero y
+ * revisa que no se lean, que o_verify() las cuente, y que al escribirlas
+ * otra vez se lean bien.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ofile.h>
+
+#define FILE_NAME	"crc.ofl"
+#define ENTRIES	2000
+#define SIZE	100
+
+/* Cambia el byte 'pos' de los datos de la entrada 'name' */
+static int damage(o_file *of, const char *name, size_t pos)
+{
+	off_t offset = o_get_offset(of, name);
+	char c = '#';
+	int fd;
+
+	if(!offset || (fd = open(FILE_NAME, O_RDWR)) < 0)
+		return 0;
+	offset += sizeof(o_metadata) + strlen(name) + 1 + pos;
+	if(pwrite(fd, &c, 1, offset) != 1) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+
+	return 1;
+}
+
+int main(void)
+{
+	o_file *of;
+	char name[32], buf[SIZE];
+	int i, ok;
+
+	unlink(FILE_NAME);
+	if(!(of = o_open(FILE_NAME, "w")))
+		return 1;
+	for(i = 0; i < ENTRIES; i++) {
+		sprintf(name, "entry%d", i);
+		memset(buf, 'a' + i % 26, SIZE);
+		o_write_entry(of, name, buf, SIZE);
+	}
+	ok = damage(of, "entry10", 0) && damage(of, "entry1500", SIZE - 1);
+	o_close(of);
+	if(!ok) {
+		printf("crc: can't damage the file\n");
+		return 1;
+	}
+
+	of = o_open(FILE_NAME, "r");
+	if(o_read_entry(of, "entry10", buf, SIZE) != 0 || o_touch_entry(of, "entry1500") != 0 ||
+	   o_read_entry(of, "entry11", buf, SIZE) != SIZE) {
+		printf("crc: damaged entries are read\n");
+		return 1;
+	}
+	if(o_verify(of, 4) != 2 || o_verify(of, 1) != 2) {
+		printf("crc: o_verify() does not find the damaged entries\n");
+		return 1;
+	}
+	o_close(of);
+
+	of = o_open(FILE_NAME, "w");
+	memset(buf, 'z', SIZE);
+	o_update_entry(of, "entry10", buf, SIZE);
+	o_delete_entry(of, "entry1500");
+	if(o_read_entry(of, "entry10", buf, SIZE) != SIZE || o_verify(of, 2) != 0) {
+		printf("crc: rewritten entries are still damaged\n");
+		return 1;
+	}
+	o_close(of);
+
+	printf("crc: ok\n");
+	unlink(FILE_NAME);
+	return 0;
+}
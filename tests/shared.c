@@ -0,0 +1,137 @@
+/* shared.c: Modo compartido. Un escritor escribe, actualiza y elimina
+ * entradas (lo que tambien compacta) mientras varios procesos lectores las
+ * leen; cada valor lleva su nombre y una suma, un lector nunca debe ver
+ * uno a medio escribir o de otra entrada.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <ofile.h>
+
+#define FILE_NAME	"shared.ofl"
+#define KEYS	500
+#define OPS	20000
+#define READERS	3
+
+static unsigned int sum(const char *buf, int len)
+{
+	unsigned int s = 0;
+
+	while(len-- > 0)
+		s = s * 31 + (unsigned char)*buf++;
+
+	return s;
+}
+
+/* "<nombre>:<relleno>" y la suma de lo anterior al final */
+static int value(char *buf, const char *name, int len)
+{
+	unsigned int s;
+	int i;
+
+	i = sprintf(buf, "%s:", name);
+	for(; i < len; i++)
+		buf[i] = 'a' + rand() % 26;
+	s = sum(buf, len);
+	memcpy(buf + len, &s, sizeof(s));
+
+	return len + sizeof(s);
+}
+
+static int value_ok(const char *buf, const char *name, int n)
+{
+	unsigned int s;
+	int len = strlen(name);
+
+	if(n < (int)sizeof(s) + len + 1 || strncmp(buf, name, len) != 0 || buf[len] != ':')
+		return 0;
+	memcpy(&s, buf + n - sizeof(s), sizeof(s));
+
+	return s == sum(buf, n - sizeof(s));
+}
+
+static int reader(int id)
+{
+	o_file *of;
+	char name[32], buf[8192];
+	long reads = 0;
+	int n, done;
+
+	if(!(of = o_open(FILE_NAME, "rs")))
+		return 1;
+	srand(id);
+	do {
+		/* Se revisa antes de leer: despues de "done" se lee una vez mas */
+		done = o_read_entry(of, "done", buf, sizeof(buf)) > 0;
+		sprintf(name, "key%d", rand() % KEYS);
+		n = o_read_entry(of, name, buf, sizeof(buf));
+		if(n > 0 && !value_ok(buf, name, n)) {
+			printf("shared: reader %d: bad \"%s\" (%d bytes)\n", id, name, n);
+			return 1;
+		}
+		reads++;
+	} while(!done);
+	o_close(of);
+
+	return reads > 0? 0 : 1;
+}
+
+int main(void)
+{
+	o_file *of;
+	char name[32], buf[8192];
+	int i, n, status, bad = 0;
+
+	unlink(FILE_NAME);
+	if(!(of = o_open(FILE_NAME, "ws")))
+		return 1;
+	o_close(of);
+
+	for(i = 0; i < READERS; i++)
+		if(fork() == 0)
+			exit(reader(i + 1));
+
+	of = o_open(FILE_NAME, "ws");
+	srand(0);
+	for(i = 0; i < OPS; i++) {
+		sprintf(name, "key%d", rand() % KEYS);
+		n = value(buf, name, 16 + rand() % (rand() % 8? 200 : 6000));
+		switch(rand() % 4) {
+		case 0:
+		case 1:
+			if(!o_write_entry(of, name, buf, n))
+				o_update_entry(of, name, buf, n);
+			break;
+		case 2:
+			o_update_entry(of, name, buf, n);
+			break;
+		default:
+			o_delete_entry(of, name);
+		}
+	}
+	o_write_entry(of, "done", "1", 1);
+	o_close(of);
+
+	for(i = 0; i < READERS; i++)
+		if(wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			bad = 1;
+
+	of = o_open(FILE_NAME, "r");
+	for(i = 0; i < KEYS; i++) {
+		sprintf(name, "key%d", i);
+		n = o_read_entry(of, name, buf, sizeof(buf));
+		if(n > 0 && !value_ok(buf, name, n)) {
+			printf("shared: reopen: bad \"%s\"\n", name);
+			bad = 1;
+		}
+	}
+	o_close(of);
+
+	if(bad)
+		return 1;
+	printf("shared: ok\n");
+	unlink(FILE_NAME);
+	return 0;
+}
@@ -0,0 +1,103 @@
+/* stream.c: Escritura y lectura por partes. Una entrada grande se escribe
+ * en partes de distinto tamano, con otras escrituras entre ellas, y se lee
+ * por partes; una abortada y una sin terminar al cerrar no quedan.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ofile.h>
+
+#define FILE_NAME	"stream.ofl"
+#define BIG	(3 * 1024 * 1024 + 7)
+
+int main(void)
+{
+	o_file *of;
+	o_entry_writer *w;
+	char *src, *dst, name[32];
+	size_t pos, len;
+	int i;
+
+	if(!(src = malloc(BIG)) || !(dst = malloc(BIG))) {
+		perror("malloc");
+		return 1;
+	}
+	srand(1);
+	for(pos = 0; pos < BIG; pos++)
+		src[pos] = rand() % 256;
+
+	unlink(FILE_NAME);
+	if(!(of = o_open(FILE_NAME, "w")))
+		return 1;
+
+	/* Reserva poco, debe crecer mientras otros escriben */
+	w = o_entry_open_write(of, "big", 1000);
+	if(!w) {
+		printf("stream: o_entry_open_write() failed\n");
+		return 1;
+	}
+	for(pos = 0, i = 0; pos < BIG; pos += len, i++) {
+		len = 1 + rand() % 50000;
+		if(len > BIG - pos)
+			len = BIG - pos;
+		if(o_entry_append(w, src + pos, len) != (int)len) {
+			printf("stream: o_entry_append() failed\n");
+			return 1;
+		}
+		sprintf(name, "small%d", i);
+		o_write_entry(of, name, src, 1 + i % 300);
+	}
+	if(o_entry_open_write(of, "small0", 0)) {
+		printf("stream: o_entry_open_write() of an existing entry\n");
+		return 1;
+	}
+	if(o_get_offset(of, "big")) {
+		printf("stream: visible before o_entry_commit()\n");
+		return 1;
+	}
+	if(o_entry_commit(w) != BIG) {
+		printf("stream: o_entry_commit() failed\n");
+		return 1;
+	}
+
+	w = o_entry_open_write(of, "aborted", 0);
+	o_entry_append(w, src, 100000);
+	o_entry_abort(w);
+	w = o_entry_open_write(of, "unfinished", 0);
+	o_entry_append(w, src, 100000);
+	o_close(of);
+
+	of = o_open(FILE_NAME, "r");
+	for(pos = 0; pos < BIG; pos += len)
+		if(!(len = o_entry_read(of, "big", dst + pos, pos, 1 + rand() % 70000))) {
+			printf("stream: o_entry_read() stopped at %lu\n", (unsigned long)pos);
+			return 1;
+		}
+	if(memcmp(src, dst, BIG) != 0 || o_entry_read(of, "big", dst, BIG, 10) != 0) {
+		printf("stream: bad data\n");
+		return 1;
+	}
+	if(o_get_offset(of, "aborted") || o_get_offset(of, "unfinished")) {
+		printf("stream: aborted or unfinished entry is visible\n");
+		return 1;
+	}
+	o_close(of);
+
+	/* Abrir para escribir libera el espacio de la que no termino */
+	of = o_open(FILE_NAME, "w");
+	while(o_compact(of, 0))
+		;
+	memset(dst, 0, BIG);
+	if(o_read_entry(of, "big", dst, BIG) != BIG || memcmp(src, dst, BIG) != 0) {
+		printf("stream: bad data after compact\n");
+		return 1;
+	}
+	o_close(of);
+
+	printf("stream: ok\n");
+	free(src);
+	free(dst);
+	unlink(FILE_NAME);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/* upgrade.c: Un fichero del formato 1 se lee tal cual si se abre para
+ * leer, sin cambiarlo, y se convierte al formato actual al abrirlo para
+ * escribir.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <ofile.h>
+
+#define FILE_NAME	"upgrade.ofl"
+#define ENTRIES	500
+
+/* El formato 1, ver o_upgrade() */
+typedef struct {
+	char fn[3];
+	size_t f_size;
+	int num;
+} v1_header;
+
+typedef struct {
+	size_t size;
+	size_t namelen;
+} v1_metadata;
+
+static int value(char *buf, int i)
+{
+	return sprintf(buf, "value of entry %d %*s", i, i % 300, "");
+}
+
+static int write_v1(void)
+{
+	v1_header header;
+	v1_metadata md;
+	char name[32], buf[512];
+	FILE *fp;
+	int i;
+
+	if(!(fp = fopen(FILE_NAME, "w")))
+		return 0;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.fn, "OFL", 3);
+	header.f_size = sizeof(header);
+	header.num = ENTRIES;
+	fwrite(&header, sizeof(header), 1, fp);
+	for(i = 0; i < ENTRIES; i++) {
+		md.namelen = sprintf(name, "entry%d", i);
+		md.size = value(buf, i);
+		fwrite(&md, sizeof(md), 1, fp);
+		fwrite(name, md.namelen + 1, 1, fp);
+		fwrite(buf, md.size, 1, fp);
+		header.f_size += sizeof(md) + md.namelen + 1 + md.size;
+	}
+	rewind(fp);
+	fwrite(&header, sizeof(header), 1, fp);
+
+	return fclose(fp) == 0;
+}
+
+static int check(o_file *of, int entries, const char *when)
+{
+	o_cursor c;
+	char name[32], buf[512], exp[512];
+	int i, len, n = 0;
+
+	for(i = 0; i < entries; i++) {
+		sprintf(name, "entry%d", i);
+		len = value(exp, i);
+		if(o_read_entry(of, name, buf, sizeof(buf)) != len || memcmp(buf, exp, len) != 0) {
+			printf("upgrade: %s: bad \"%s\"\n", when, name);
+			return 0;
+		}
+	}
+	memset(&c, 0, sizeof(c));
+	while(o_foreach(of, &c))
+		n++;
+	if(n != entries) {
+		printf("upgrade: %s: o_foreach() found %d entries\n", when, n);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(void)
+{
+	o_file *of;
+	o_file_header header;
+	struct stat before, after;
+	char name[32], buf[512];
+	int fd;
+
+	unlink(FILE_NAME);
+	if(!write_v1()) {
+		perror("write_v1");
+		return 1;
+	}
+	stat(FILE_NAME, &before);
+
+	/* Leer no escribe nada */
+	if(!(of = o_open(FILE_NAME, "r")) || !check(of, ENTRIES, "read only"))
+		return 1;
+	o_close(of);
+	stat(FILE_NAME, &after);
+	if(after.st_size != before.st_size || after.st_mtime != before.st_mtime || after.st_ino != before.st_ino) {
+		printf("upgrade: a read only open changed the file\n");
+		return 1;
+	}
+
+	if(!(of = o_open(FILE_NAME, "w")) || !check(of, ENTRIES, "upgraded"))
+		return 1;
+	sprintf(name, "entry%d", ENTRIES);
+	o_write_entry(of, name, buf, value(buf, ENTRIES));
+	o_close(of);
+
+	fd = open(FILE_NAME, O_RDONLY);
+	if(fd < 0 || read(fd, &header, sizeof(header)) != sizeof(header) || header.version != O_VERSION) {
+		printf("upgrade: the file was not converted\n");
+		return 1;
+	}
+	close(fd);
+	if(access(FILE_NAME ".upgrade", F_OK) == 0) {
+		printf("upgrade: the temporary copy is still there\n");
+		return 1;
+	}
+
+	of = o_open(FILE_NAME, "r");
+	if(!check(of, ENTRIES + 1, "reopen") || o_verify(of, 2) != 0)
+		return 1;
+	o_close(of);
+
+	printf("upgrade: ok\n");
+	unlink(FILE_NAME);
+	return 0;
+}